@@ -1,10 +1,9 @@
 // genCSV.cpp
 // Ejercicio 1 - Generador de Datos de Prueba con Procesos y Memoria Compartida
-// Compilar: g++ -std=gnu++17 genCSV.cpp -o genCSV
-// Ejecutar: ./genCSV <N_generadores> <total_registros> <salida.csv>
+// Compilar: g++ -std=gnu++17 -pthread genCSV.cpp -o genCSV
+// Ejecutar: ./genCSV <N_generadores> <total_registros> <salida.csv> [opciones]   (ver print_help)
 
 #include <iostream>
-#include <fstream>
 #include <vector>
 #include <string>
 #include <cstring>
@@ -13,18 +12,40 @@
 #include <ctime>
 #include <cstdlib>
 #include <algorithm> // Para std::min
+#include <queue>
+#include <charconv>    // Para std::to_chars
+#include <string_view>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <thread>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <atomic>
+#include <climits>
+#include <cstdint>
 
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <sys/sem.h>
 #include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 using namespace std;
 
 // ------------------------------- IPC Keys -----------------------------------
-#define SHM_KEY 0x4B1D1234
-#define SEM_KEY 0x4B1D5678
+// Los hijos heredan la memoria compartida y los semáforos por fork, así que no
+// hace falta una clave fija: con IPC_PRIVATE dos corridas en el mismo host no
+// chocan entre sí.
+#define SHM_KEY IPC_PRIVATE
+#define SEM_KEY IPC_PRIVATE
 
 // ----------------------------- Semáforos (SysV) ------------------------------
 union semun {
@@ -53,31 +74,584 @@ static void sem_signal_idx(int semid, int idx) {
         _exit(1);
     }
 }
+// Suma (o resta) n unidades de una sola vez: un productor reserva o publica
+// todo su bloque con un único semop en lugar de uno por registro.
+static void sem_op_n(int semid, int idx, int n) {
+    sembuf op{static_cast<unsigned short>(idx), static_cast<short>(n), 0};
+    if (semop(semid, &op, 1) == -1) {
+        perror("semop n");
+        _exit(1);
+    }
+}
+
+// ---------------------------------- Futex ------------------------------------
+// Espera/despertar directo sobre una palabra de la memoria compartida. Solo se
+// entra al kernel cuando hay que dormir de verdad (anillo vacío o lleno); en el
+// camino rápido productor y consumidor se coordinan únicamente con atómicos.
+// No se usa FUTEX_PRIVATE_FLAG porque la palabra la comparten varios procesos.
+static_assert(sizeof(atomic<uint32_t>) == sizeof(uint32_t), "futex requiere palabras de 32 bits");
+static_assert(atomic<bool>::is_always_lock_free, "la bandera terminar vive en memoria compartida entre procesos");
+
+static void futex_wait(atomic<uint32_t>* addr, uint32_t esperado) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT, esperado, nullptr, nullptr, 0);
+}
+static void futex_wake(atomic<uint32_t>* addr) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
 
 // ----------------------------- Memoria Compartida ----------------------------
+#define SLOTS_DEFAULT 256 // capacidad por defecto del anillo (K)
+// Tamaño de los bloques de IDs que reserva cada generador. Se adapta a la
+// velocidad observada para que un bloque lleve ~BLOQUE_OBJETIVO_NS de trabajo.
+#define BLOQUE_MIN 16
+#define BLOQUE_MAX 4096
+#define BLOQUE_OBJETIVO_NS 2000000L // ~2 ms por bloque
+#define BLOQUE_FIJO 256             // con --semilla, Fuente se asigna en ronda por bloques de este tamaño
+
+// Transporte entre generadores y coordinador
+enum ModoIPC {
+    IPC_SEMAFOROS, // un anillo común protegido con semáforos SysV
+    IPC_SPSC       // un anillo por generador, solo atómicos + futex
+};
+static ModoIPC modoIPC = IPC_SEMAFOROS;
+
+#define REG_MAX 512 // largo máximo de una línea CSV
+
+// Slot del anillo productor->consumidor
+struct Slot {
+    int  id_publicado;              // ID del registro publicado
+    int  largo;                     // bytes válidos en registro
+    char registro[REG_MAX];         // línea CSV (sin salto de línea ni '\0')
+};
+
 struct SharedData {
     // Control global
-    int next_id;           // siguiente ID a asignar (1..total_registros)
+    atomic<int> next_id;   // siguiente ID a asignar (1..total_registros), se reserva con CAS
     int total_registros;   // total a generar
-    int total_escritos;    // contador de registros que el coordinador ya volcó al CSV
-    bool terminar;         // bandera de finalización global
-    int generadoresActivos;  // contador de procesos hijos activos
+    atomic<int> total_escritos; // contador de registros que el coordinador ya volcó al CSV
+    atomic<bool> terminar; // bandera de finalización global (la leen generadores y coordinador a la vez)
+    atomic<int> generadoresActivos;  // contador de procesos hijos activos
+    atomic<int> filasLargas;         // --directo: filas que no entraron en su ancho fijo
 
-    // Slot de intercambio productor->consumidor
-    // bool nuevoRegistro;    // <-- ELIMINADO: ahora gestionado por SEM_EMPTY_SLOT/SEM_FULL_SLOT
-    int  id_publicado;              // ID del registro publicado
-    char registro[512];             // línea CSV parcial (sin salto de línea)
+    // Anillo de K slots (los slots van a continuación de esta estructura).
+    // SEM_EMPTY_SLOT cuenta slots libres y SEM_FULL_SLOT slots publicados
+    // (más un aviso extra cuando termina el último generador).
+    // head solo lo mueven los productores (bajo SEM_MUTEX); tail solo el
+    // coordinador, que es el único consumidor y por eso lee sin el mutex.
+    unsigned capacidad;    // K
+    atomic<unsigned> head; // próxima posición a escribir (monótona, se usa mod K)
+    unsigned tail;         // próxima posición a leer (monótona, se usa mod K)
+
+    size_t offsetEstad;    // desplazamiento de las N EstadGenerador dentro de la región
+
+    // Modo SPSC: el coordinador duerme en coordSeq cuando todos los anillos
+    // están vacíos. Los productores lo incrementan al publicar y solo hacen
+    // FUTEX_WAKE si coordDurmiendo está en 1.
+    atomic<uint32_t> coordSeq;
+    atomic<uint32_t> coordDurmiendo;
 
     // Padding opcional
     char _pad[64];
 };
 
+// Modo SPSC: un anillo por generador (van a continuación de SharedData, y
+// después de todos ellos los N*K slots). head lo escribe solo el generador
+// dueño y tail solo el coordinador; cada uno en su propia línea de caché.
+struct AnilloSPSC {
+    alignas(64) atomic<uint32_t> head;          // próxima posición a escribir
+    atomic<uint32_t> terminado;                 // 1 = el generador no publicará más
+    alignas(64) atomic<uint32_t> tail;          // próxima posición a leer (palabra futex del productor)
+    atomic<uint32_t> prodDurmiendo;             // 1 = el productor espera espacio en tail
+};
+
 static int shmid = -1;
 static SharedData* shm = nullptr;
+static size_t shmPrivadoBytes = 0; // motor de hilos: la región es un mmap anónimo, no SysV
+
+static Slot* slotsDe(SharedData* d) {
+    return reinterpret_cast<Slot*>(d + 1);
+}
+
+// ------------------------------- Métricas ------------------------------------
+// Contadores de cada generador, al final de la región compartida. Cada entrada
+// la escribe un único generador (sin contención) y el monitor la lee en vivo.
+struct alignas(64) EstadGenerador {
+    atomic<uint64_t> registros;      // registros publicados
+    atomic<uint64_t> nsEsperaSlots;  // bloqueado esperando lugar (SEM_EMPTY_SLOT o futex de anillo lleno)
+    atomic<uint64_t> nsEsperaMutex;  // bloqueado en SEM_MUTEX
+};
+
+// Contadores del coordinador (viven en su proceso; los lee el hilo monitor)
+#define HIST_BUCKETS 48
+struct EstadCoordinador {
+    atomic<uint64_t> nsEsperaDatos{0}; // bloqueado esperando registros
+    atomic<uint64_t> tandas{0};        // despertares con datos
+    atomic<uint64_t> nsTandas{0};      // tiempo total volcando tandas
+    atomic<uint64_t> nsTandaMax{0};
+    atomic<uint64_t> histTanda[HIST_BUCKETS] = {}; // bucket i: [2^i, 2^(i+1)) ns
+};
+static EstadCoordinador estadCoord;
+
+// Solo hay un escritor por contador: alcanza con load + store relajados
+static void sumar(atomic<uint64_t>& c, uint64_t v) {
+    c.store(c.load(memory_order_relaxed) + v, memory_order_relaxed);
+}
+
+static void registrarTanda(uint64_t ns) {
+    sumar(estadCoord.tandas, 1);
+    sumar(estadCoord.nsTandas, ns);
+    if (ns > estadCoord.nsTandaMax.load(memory_order_relaxed)) estadCoord.nsTandaMax.store(ns, memory_order_relaxed);
+    int b = ns > 0 ? 63 - __builtin_clzll(ns) : 0;
+    sumar(estadCoord.histTanda[std::min(b, HIST_BUCKETS - 1)], 1);
+}
+
+// Percentil aproximado de la latencia de tanda (cota superior del bucket)
+static uint64_t percentilTanda(double p) {
+    uint64_t total = estadCoord.tandas.load();
+    if (total == 0) return 0;
+    uint64_t objetivo = static_cast<uint64_t>(p * total), acum = 0;
+    for (int i = 0; i < HIST_BUCKETS; ++i) {
+        acum += estadCoord.histTanda[i].load();
+        if (acum > objetivo || acum == total) return 2ULL << i;
+    }
+    return estadCoord.nsTandaMax.load();
+}
+
+static EstadGenerador* estadDe(SharedData* d) {
+    return reinterpret_cast<EstadGenerador*>(reinterpret_cast<char*>(d) + d->offsetEstad);
+}
+
+static AnilloSPSC* anillosDe(SharedData* d) {
+    return reinterpret_cast<AnilloSPSC*>(d + 1);
+}
+
+// Slots del anillo SPSC del generador g (0..N-1)
+static Slot* slotsAnilloDe(SharedData* d, int N, int g) {
+    return reinterpret_cast<Slot*>(anillosDe(d) + N) + static_cast<size_t>(g) * d->capacidad;
+}
+
+// ------------------------------ Escritor CSV ---------------------------------
+// Acumula las líneas en buffers grandes alineados a página y los vuelca juntos
+// con un writev, en lugar de un write(2) por registro. Cuándo se vuelca lo
+// decide la PoliticaFlush; si no se pide nada, solo cuando se llenan todos los
+// buffers y al cerrar.
+#define ESCRITOR_BUF_BYTES (1u << 20) // 1 MiB por buffer
+#define ESCRITOR_N_BUFS    8
+
+struct PoliticaFlush {
+    long cadaRegistros = 0; // volcar cada N registros (0 = no)
+    long cadaMs = 0;        // volcar cada T milisegundos (0 = no)
+    bool fdatasync = false; // fdatasync después de cada volcado
+};
+
+static long ahoraMs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+class EscritorCSV {
+public:
+    ~EscritorCSV() {
+        if (fd_ != -1) close(fd_);
+        for (char* b : bufs_) free(b);
+    }
+
+    bool abrir(const string& ruta, const PoliticaFlush& pol) {
+        fd_ = open(ruta.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_ == -1) return false;
+        pol_ = pol;
+        for (int i = 0; i < ESCRITOR_N_BUFS; ++i) {
+            void* b = nullptr;
+            if (posix_memalign(&b, 4096, ESCRITOR_BUF_BYTES) != 0) return false;
+            bufs_.push_back(static_cast<char*>(b));
+        }
+        ultimoFlushMs_ = ahoraMs();
+        return true;
+    }
+
+    // Agrega una línea (sin '\n'; el salto lo pone el escritor)
+    void escribir(const char* linea, size_t len) {
+        if (usado_ + len + 1 > ESCRITOR_BUF_BYTES) {
+            lleno_[actual_] = usado_;
+            if (++actual_ == ESCRITOR_N_BUFS) volcar();
+            usado_ = 0;
+        }
+        char* b = bufs_[actual_];
+        memcpy(b + usado_, linea, len);
+        b[usado_ + len] = '\n';
+        usado_ += len + 1;
+        ++pendientes_;
+    }
+
+    // Fin de una tanda de registros: aplicar la política de volcado
+    void finDeTanda() {
+        if (pendientes_ == 0) return;
+        if (pol_.cadaRegistros > 0 && pendientes_ >= pol_.cadaRegistros) {
+            volcar();
+        } else if (pol_.cadaMs > 0 && ahoraMs() - ultimoFlushMs_ >= pol_.cadaMs) {
+            volcar();
+        }
+    }
+
+    // Vuelca lo pendiente y cierra. Devuelve false si hubo algún error de E/S.
+    // Solo sincroniza con el disco si la política lo pide (volcar hace el fdatasync).
+    bool cerrar() {
+        if (fd_ == -1) return !error_;
+        volcar();
+        if (close(fd_) == -1) error_ = true;
+        fd_ = -1;
+        return !error_;
+    }
+
+    uint64_t bytesEscritos() const { return bytes_.load(memory_order_relaxed); }
+
+private:
+    // Un único writev con todos los buffers llenos más el actual
+    void volcar() {
+        iovec iov[ESCRITOR_N_BUFS];
+        int n = 0;
+        for (int i = 0; i < actual_ && i < ESCRITOR_N_BUFS; ++i) {
+            iov[n++] = {bufs_[i], lleno_[i]};
+        }
+        if (actual_ < ESCRITOR_N_BUFS && usado_ > 0) {
+            iov[n++] = {bufs_[actual_], usado_};
+        }
+
+        int primero = 0;
+        while (primero < n && !error_) {
+            ssize_t w = writev(fd_, iov + primero, n - primero);
+            if (w == -1) {
+                if (errno == EINTR) continue;
+                perror("writev");
+                error_ = true;
+                break;
+            }
+            bytes_.store(bytes_.load(memory_order_relaxed) + static_cast<uint64_t>(w), memory_order_relaxed);
+            // Escritura parcial: avanzar sobre los iovec ya escritos
+            while (primero < n && static_cast<size_t>(w) >= iov[primero].iov_len) {
+                w -= static_cast<ssize_t>(iov[primero].iov_len);
+                ++primero;
+            }
+            if (primero < n) {
+                iov[primero].iov_base = static_cast<char*>(iov[primero].iov_base) + w;
+                iov[primero].iov_len -= static_cast<size_t>(w);
+            }
+        }
+
+        if (pol_.fdatasync && !error_ && fdatasync(fd_) == -1) {
+            perror("fdatasync");
+            error_ = true;
+        }
+        actual_ = 0;
+        usado_ = 0;
+        pendientes_ = 0;
+        ultimoFlushMs_ = ahoraMs();
+    }
+
+    int fd_ = -1;
+    PoliticaFlush pol_;
+    vector<char*> bufs_;
+    size_t lleno_[ESCRITOR_N_BUFS] = {};
+    int actual_ = 0;          // buffer en el que se está escribiendo
+    size_t usado_ = 0;        // bytes usados del buffer actual
+    long pendientes_ = 0;     // registros aún no volcados
+    long ultimoFlushMs_ = 0;
+    atomic<uint64_t> bytes_{0}; // lo lee el hilo monitor
+    bool error_ = false;
+};
+
+// ------------------------- Reordenamiento por ID ------------------------------
+// Modo --ordenado: los registros llegan en el orden en que se publican, pero se
+// emiten estrictamente por ID. Los que caen dentro de la ventana [siguiente,
+// siguiente+W) esperan en memoria en la posición id % W. Los que vienen más
+// adelantados se juntan en un montículo; cuando éste llega a W registros se
+// vuelca ordenado como una "corrida" a un archivo temporal. Al emitir, el
+// siguiente ID puede estar en la ventana, en el montículo o al frente de alguna
+// corrida, que se leen secuencialmente. Así la memoria queda acotada (~2W
+// registros + un buffer chico por corrida) y nunca se frena a un generador que
+// va adelantado. Para que las corridas vivas no crezcan con total/W, cuando se
+// juntan CORRIDAS_FUSION de un mismo nivel se funden en una del nivel
+// siguiente (cada registro se reescribe ~log(total/W) veces como mucho).
+#define VENTANA_DEFAULT 65536
+#define CORRIDA_BUF_BYTES (64 * 1024)
+#define CORRIDAS_FUSION 16
+
+class ReordenadorIDs {
+public:
+    ReordenadorIDs(EscritorCSV& csv, int ventana)
+        : csv_(csv), W_(ventana), ventana_(ventana), presente_(ventana, 0) {}
+
+    ~ReordenadorIDs() {
+        if (fdSpill_ != -1) close(fdSpill_);
+    }
+
+    // Crea el archivo de desborde junto a la salida y lo desvincula enseguida:
+    // desaparece solo al cerrar el descriptor, incluso si el proceso muere.
+    bool abrir(const string& rutaSalida) {
+        string plantilla = rutaSalida + ".reorden.XXXXXX";
+        vector<char> ruta(plantilla.begin(), plantilla.end());
+        ruta.push_back('\0');
+        fdSpill_ = mkstemp(ruta.data());
+        if (fdSpill_ == -1) return false;
+        unlink(ruta.data());
+        return true;
+    }
+
+    void recibir(int id, const char* linea, size_t len) {
+        if (id < siguiente_) {
+            cerr << "ADVERTENCIA: ID " << id << " repetido, se descarta.\n";
+            return;
+        }
+        if (id - siguiente_ < W_) {
+            int pos = id % W_;
+            ventana_[pos].assign(linea, len);
+            presente_[pos] = 1;
+            if (id == siguiente_) emitirListos();
+            return;
+        }
+        pendientes_.push({id, string(linea, len)});
+        if (static_cast<int>(pendientes_.size()) >= W_) volcarCorrida();
+    }
+
+    // Emitir todo lo que quede. Si faltan IDs (generación interrumpida) se
+    // saltean los huecos y se sigue en orden.
+    bool finalizar() {
+        while (true) {
+            emitirListos();
+            int minimo = INT_MAX;
+            for (int i = 0; i < W_; ++i) {
+                int id = siguiente_ + i;
+                if (presente_[id % W_]) { minimo = id; break; }
+            }
+            if (!pendientes_.empty()) minimo = std::min(minimo, pendientes_.top().first);
+            if (!frentes_.empty()) minimo = std::min(minimo, frentes_.top().first);
+            if (minimo == INT_MAX) break;
+            cerr << "ADVERTENCIA: faltan los IDs " << siguiente_ << ".." << (minimo - 1) << "\n";
+            siguiente_ = minimo;
+        }
+        return !error_;
+    }
+
+    long corridas() const { return volcadas_; }
+
+private:
+    struct Corrida {
+        off_t inicio, pos, fin;  // la corrida en el archivo de desborde; [pos, fin) falta leer
+        int nivel = 0;           // 0 = volcada del montículo; n = fusión de corridas de nivel n-1
+        vector<char> buf;
+        size_t bufPos = 0, bufLen = 0;
+    };
+    typedef pair<int, string> Registro;
+    struct MayorId {
+        bool operator()(const Registro& a, const Registro& b) const { return a.first > b.first; }
+    };
+    typedef pair<int, size_t> Frente; // (id al frente, índice de corrida)
+    typedef priority_queue<Frente, vector<Frente>, greater<Frente>> ColaFrentes;
+
+    void emitirListos() {
+        while (true) {
+            int pos = siguiente_ % W_;
+            if (presente_[pos]) {
+                csv_.escribir(ventana_[pos].data(), ventana_[pos].size());
+                presente_[pos] = 0;
+            } else if (!pendientes_.empty() && pendientes_.top().first == siguiente_) {
+                const string& r = pendientes_.top().second;
+                csv_.escribir(r.data(), r.size());
+                pendientes_.pop();
+            } else if (!frentes_.empty() && frentes_.top().first == siguiente_) {
+                size_t c = frentes_.top().second;
+                frentes_.pop();
+                csv_.escribir(lineaFrente_[c].data(), lineaFrente_[c].size());
+                avanzarCorrida(c, frentes_);
+            } else {
+                break;
+            }
+            ++siguiente_;
+        }
+    }
+
+    // Formato de la corrida: [int32 id][uint32 largo][bytes] ... ordenado por id
+    static void agregarRegistro(vector<char>& tmp, int32_t id, const string& linea) {
+        uint32_t len = static_cast<uint32_t>(linea.size());
+        tmp.insert(tmp.end(), reinterpret_cast<const char*>(&id), reinterpret_cast<const char*>(&id) + 4);
+        tmp.insert(tmp.end(), reinterpret_cast<const char*>(&len), reinterpret_cast<const char*>(&len) + 4);
+        tmp.insert(tmp.end(), linea.begin(), linea.end());
+    }
+
+    void volcarCorrida() {
+        off_t inicio = finSpill_;
+        vector<char> tmp;
+        tmp.reserve(CORRIDA_BUF_BYTES);
+        while (!pendientes_.empty()) {
+            agregarRegistro(tmp, pendientes_.top().first, pendientes_.top().second);
+            pendientes_.pop();
+            if (tmp.size() >= CORRIDA_BUF_BYTES) escribirSpill(tmp);
+        }
+        escribirSpill(tmp);
+        agregarCorrida(inicio, 0);
+        ++volcadas_;
+        for (int nivel = 0; fundirNivel(nivel); ++nivel) {}
+    }
+
+    // Las entradas de corridas agotadas se reusan, así corridas_ no crece con total/W
+    void agregarCorrida(off_t inicio, int nivel) {
+        size_t i = corridas_.size();
+        if (libres_.empty()) {
+            corridas_.emplace_back();
+            lineaFrente_.emplace_back();
+        } else {
+            i = libres_.back();
+            libres_.pop_back();
+        }
+        Corrida& c = corridas_[i];
+        c.inicio = c.pos = inicio;
+        c.fin = finSpill_;
+        c.nivel = nivel;
+        c.bufPos = c.bufLen = 0;
+        if (niveles_.size() <= static_cast<size_t>(nivel)) niveles_.resize(nivel + 1);
+        niveles_[nivel].push_back(i);
+        avanzarCorrida(i, frentes_);
+    }
+
+    // Si hay CORRIDAS_FUSION corridas vivas del nivel, las mezcla en una sola
+    // del nivel siguiente al final del archivo (las viejas se agotan y liberan).
+    bool fundirNivel(int nivel) {
+        if (niveles_[nivel].size() < CORRIDAS_FUSION) return false;
+        vector<char> enGrupo(corridas_.size(), 0);
+        for (size_t i : niveles_[nivel]) enGrupo[i] = 1;
+
+        // Los frentes del grupo pasan a un montículo propio
+        ColaFrentes grupo;
+        vector<Frente> resto;
+        for (; !frentes_.empty(); frentes_.pop()) {
+            if (enGrupo[frentes_.top().second]) grupo.push(frentes_.top());
+            else resto.push_back(frentes_.top());
+        }
+        frentes_ = ColaFrentes(greater<Frente>(), std::move(resto));
+
+        off_t inicio = finSpill_;
+        vector<char> tmp;
+        tmp.reserve(CORRIDA_BUF_BYTES);
+        while (!grupo.empty() && !error_) {
+            Frente f = grupo.top();
+            grupo.pop();
+            agregarRegistro(tmp, f.first, lineaFrente_[f.second]);
+            if (tmp.size() >= CORRIDA_BUF_BYTES) escribirSpill(tmp);
+            avanzarCorrida(f.second, grupo);
+        }
+        escribirSpill(tmp);
+        agregarCorrida(inicio, nivel + 1);
+        return true;
+    }
+
+    void escribirSpill(vector<char>& datos) {
+        size_t hecho = 0;
+        while (hecho < datos.size()) {
+            ssize_t w = pwrite(fdSpill_, datos.data() + hecho, datos.size() - hecho, finSpill_);
+            if (w == -1) {
+                if (errno == EINTR) continue;
+                perror("pwrite desborde");
+                error_ = true;
+                break;
+            }
+            hecho += static_cast<size_t>(w);
+            finSpill_ += w;
+        }
+        datos.clear();
+    }
+
+    // Garantiza n bytes contiguos disponibles en el buffer de la corrida. El
+    // buffer se reusa y no pasa de lo que le queda a la corrida (ni de
+    // CORRIDA_BUF_BYTES, salvo un registro más largo)
+    bool asegurar(Corrida& c, size_t n) {
+        size_t resto = c.bufLen - c.bufPos;
+        if (resto >= n) return true;
+        size_t porLeer = static_cast<size_t>(c.fin - c.pos);
+        if (resto + porLeer < n) return false;
+        size_t cap = std::max(n, std::min<size_t>(CORRIDA_BUF_BYTES, resto + porLeer));
+        memmove(c.buf.data(), c.buf.data() + c.bufPos, resto);
+        if (c.buf.size() < cap) c.buf.resize(cap);
+        size_t aLeer = std::min(c.buf.size() - resto, porLeer);
+        ssize_t r = pread(fdSpill_, c.buf.data() + resto, aLeer, c.pos);
+        if (r < 0) {
+            perror("pread desborde");
+            error_ = true;
+            return false;
+        }
+        c.pos += r;
+        c.bufPos = 0;
+        c.bufLen = resto + static_cast<size_t>(r);
+        return c.bufLen >= n;
+    }
+
+    // Corrida leída entera: libera su buffer, su lugar en el archivo (si el FS
+    // no sabe hacer agujeros, solo ocupa disco) y su entrada en corridas_
+    void agotar(size_t c) {
+        Corrida& cor = corridas_[c];
+        vector<char>().swap(cor.buf);
+        string().swap(lineaFrente_[c]);
+        fallocate(fdSpill_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, cor.inicio, cor.fin - cor.inicio);
+        vector<size_t>& nivel = niveles_[cor.nivel];
+        nivel.erase(std::find(nivel.begin(), nivel.end(), c));
+        libres_.push_back(c);
+    }
+
+    // Carga el próximo registro de la corrida c y lo pone en el montículo de frentes
+    void avanzarCorrida(size_t c, ColaFrentes& frentes) {
+        Corrida& cor = corridas_[c];
+        if (!asegurar(cor, 8)) {
+            agotar(c);
+            return;
+        }
+        int32_t id;
+        uint32_t len;
+        memcpy(&id, cor.buf.data() + cor.bufPos, 4);
+        memcpy(&len, cor.buf.data() + cor.bufPos + 4, 4);
+        cor.bufPos += 8;
+        if (!asegurar(cor, len)) return;
+        lineaFrente_[c].assign(cor.buf.data() + cor.bufPos, len);
+        cor.bufPos += len;
+        frentes.push({id, c});
+    }
+
+    EscritorCSV& csv_;
+    int W_;
+    int siguiente_ = 1;
+    vector<string> ventana_;
+    vector<char> presente_;
+    priority_queue<Registro, vector<Registro>, MayorId> pendientes_;
+
+    int fdSpill_ = -1;
+    off_t finSpill_ = 0;
+    vector<Corrida> corridas_;
+    vector<string> lineaFrente_; // registro al frente de cada corrida
+    ColaFrentes frentes_;
+    vector<vector<size_t>> niveles_; // corridas vivas de cada nivel
+    vector<size_t> libres_;          // entradas de corridas_ agotadas
+    long volcadas_ = 0;              // corridas de nivel 0
+    bool error_ = false;
+};
+
+// Destino de los registros que drena el coordinador: directo al escritor o,
+// en modo --ordenado, a través del reordenador.
+struct Salida {
+    EscritorCSV& csv;
+    ReordenadorIDs* reorden;
+
+    void registro(int id, const char* linea, size_t len) {
+        if (reorden) reorden->recibir(id, linea, len);
+        else csv.escribir(linea, len);
+    }
+};
 
 // ----------------------------- Limpieza Global -------------------------------
 static void limpiarRecursos(bool desdeSignal = false) {
-    if (shm) {
+    if (shm && shmPrivadoBytes > 0) {
+        munmap(shm, shmPrivadoBytes);
+        shm = nullptr;
+        shmPrivadoBytes = 0;
+    } else if (shm) {
         shmdt(shm);
         shm = nullptr;
     }
@@ -97,141 +671,1206 @@ static void sigint_handler(int) {
     if (shm) {
         // Proteger acceso mínimo
         // No usamos semáforo aquí para evitar deadlock por señales; marcamos y dejamos que salgan.
-        shm->terminar = true;
+        shm->terminar.store(true);
     }
     limpiarRecursos(true);
 }
 
 // -------------------------- Generación de datos ------------------------------
-static string generarRegistroAleatorio(int id, int idHijo) {
-    // Campos de ejemplo: ID,Nombre,Edad,Ciudad,Fuente
-    static const char* nombres[] = {
-        "Ana","Luis","Mica","Tomas","Sofia","Lucas","Valen","Agus","Cesar","Lauti"
-    };
-    static const char* ciudades[] = {
-        "Buenos Aires","Cordoba","Rosario","La Plata","Salta","Mendoza","Mar del Plata"
-    };
+// Semilla de --semilla (si no se da, cada corrida usa una distinta)
+static bool semillaFija = false;
+static uint64_t semillaUsuario = 0;
+
+static uint64_t splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// xoshiro256** (Blackman/Vigna): propio de cada generador, sin estado global
+// compartido como rand().
+struct Xoshiro256 {
+    uint64_t s[4];
+
+    explicit Xoshiro256(uint64_t semilla) {
+        for (uint64_t& v : s) v = splitmix64(semilla);
+    }
 
-    string nombre = nombres[rand() % (sizeof(nombres)/sizeof(nombres[0]))];
-    int    edad   = 18 + (rand() % 61); // 18..78
-    string ciudad = ciudades[rand() % (sizeof(ciudades)/sizeof(ciudades[0]))];
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
 
-    // Formato CSV: ID,Nombre,Edad,Ciudad,Fuente
-    string linea  = to_string(id) + "," + nombre + "," + to_string(edad) + "," + ciudad
-                  + ",Gen" + to_string(idHijo);
-    return linea;
+    uint64_t siguiente() {
+        uint64_t r = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return r;
+    }
+
+    // Entero uniforme en [0, n) por multiplicación (Lemire), sin el sesgo ni la división de %
+    uint32_t rango(uint32_t n) {
+        return static_cast<uint32_t>(((siguiente() >> 32) * n) >> 32);
+    }
+};
+
+static uint64_t semillaGenerador(int idHijo) {
+    uint64_t base = (static_cast<uint64_t>(time(nullptr)) << 20) ^ static_cast<uint64_t>(getpid());
+    uint64_t x = base ^ (static_cast<uint64_t>(idHijo) * 0xD1B54A32D192ED03ULL);
+    return splitmix64(x);
 }
 
-// --------------------------- Proceso Generador -------------------------------
-static void procesoGenerador(int idHijo) {
-    srand(static_cast<unsigned>(time(nullptr)) ^ (getpid() << 16) ^ (idHijo * 1337));
+// Con --semilla cada ID sortea con su propio PRNG, derivado de la semilla y
+// del ID: el contenido no depende de qué generador tome el ID ni del tamaño
+// de los bloques, que siguen siendo los adaptativos de siempre.
+static Xoshiro256& rngFila(Xoshiro256& rng, int id) {
+    if (semillaFija) {
+        uint64_t x = semillaUsuario ^ (static_cast<uint64_t>(id) * 0xD1B54A32D192ED03ULL);
+        rng = Xoshiro256(splitmix64(x));
+    }
+    return rng;
+}
 
-    while (true) {
-        // Bloque de IDs: necesita el mutex global
-        sem_wait_idx(semid, SEM_MUTEX);
+// Generador que figura en la columna Fuente. Con --semilla el reparto real
+// cambia entre corridas, así que figura el dueño nominal del ID: bloques de
+// BLOQUE_FIJO IDs repartidos en ronda entre los N generadores.
+static int fuenteDe(int id, int idHijo, int N) {
+    return semillaFija ? static_cast<int>((id - 1) / BLOQUE_FIJO % N) + 1 : idHijo;
+}
 
-        if (shm->terminar) {
-            sem_signal_idx(semid, SEM_MUTEX);
-            break;
+static char* copiar(char* p, string_view v) {
+    memcpy(p, v.data(), v.size());
+    return p + v.size();
+}
+
+static int digitos(long long v) {
+    int d = v < 0 ? 2 : 1;
+    if (v < 0) v = -v;
+    while (v >= 10) { v /= 10; ++d; }
+    return d;
+}
+
+// ---------------------------------- Esquema ----------------------------------
+// Columnas del CSV. Sin --esquema se usa el de siempre (ID,Nombre,Edad,Ciudad,
+// Fuente con elecciones uniformes); con --esquema se leen de un archivo, una
+// columna por línea:
+//
+//   # nombre  tipo  distribución y parámetros       = valores (solo pool)
+//   ID        id
+//   Nombre    pool  uniforme                         = Ana,Luis,Mica
+//   Ciudad    pool  zipf 1.2                         = Buenos Aires,Cordoba,Salta
+//   Plan      pool  pesos                            = Free:80,Pro:15,Empresa:5
+//   Apellido  pool  uniforme                         = @apellidos.txt
+//   Edad      int   uniforme 18 78
+//   Ingreso   int   normal 45000 12000 5000 200000   (media desvío mín máx)
+//   Orden     int   secuencial 1000 5                (inicio + (ID-1)*paso)
+//   Usuario   unico u-                               (prefijo + 7 caracteres, distinto por ID)
+//   Fuente    gen                                    ("Gen" + generador)
+//
+// El esquema se compila una sola vez (antes del fork) en una tabla de
+// emisores: las distribuciones no uniformes quedan en tablas alias, así que
+// por fila solo hay un sorteo O(1) y un memcpy/to_chars por columna.
+enum TipoColumna { COL_ID, COL_INT, COL_SECUENCIAL, COL_POOL, COL_UNICO, COL_GEN };
+
+// Método alias de Vose: sorteo O(1) para cualquier distribución discreta
+struct TablaAlias {
+    vector<uint64_t> umbral; // probabilidad de quedarse con i, escalada a 2^32
+    vector<uint32_t> alias;
+
+    void construir(const vector<double>& pesos) {
+        size_t n = pesos.size();
+        double suma = 0;
+        for (double w : pesos) suma += w;
+        vector<double> p(n);
+        vector<uint32_t> chicos, grandes;
+        for (size_t i = 0; i < n; ++i) {
+            p[i] = pesos[i] * n / suma;
+            (p[i] < 1.0 ? chicos : grandes).push_back(static_cast<uint32_t>(i));
+        }
+        umbral.assign(n, 1ULL << 32);
+        alias.resize(n);
+        for (size_t i = 0; i < n; ++i) alias[i] = static_cast<uint32_t>(i);
+        while (!chicos.empty() && !grandes.empty()) {
+            uint32_t c = chicos.back(), g = grandes.back();
+            chicos.pop_back();
+            umbral[c] = static_cast<uint64_t>(p[c] * 4294967296.0);
+            alias[c] = g;
+            p[g] -= 1.0 - p[c];
+            if (p[g] < 1.0) {
+                grandes.pop_back();
+                chicos.push_back(g);
+            }
+        }
+        // Lo que sobra (por redondeo) queda con probabilidad 1
+    }
+
+    uint32_t sortear(Xoshiro256& rng) const {
+        uint64_t r = rng.siguiente();
+        uint32_t i = static_cast<uint32_t>(((r >> 32) * umbral.size()) >> 32);
+        return static_cast<uint32_t>(r) < umbral[i] ? i : alias[i];
+    }
+};
+
+struct Columna {
+    string nombre;
+    TipoColumna tipo = COL_ID;
+    bool uniforme = true;          // false: sortear con la tabla alias
+    long long a = 0, b = 0;        // COL_INT: mín/máx; COL_SECUENCIAL: inicio/paso
+    vector<string> valores;        // COL_POOL
+    vector<string_view> vistas;    // COL_POOL, armadas en compilar()
+    TablaAlias tabla;              // COL_POOL no uniforme, o COL_INT normal (índice desde a)
+    string prefijo;                // COL_UNICO
+};
+
+#define UNICO_LARGO 7  // 36^7 > 2^32: cualquier ID de 32 bits entra
+
+struct Esquema {
+    vector<Columna> columnas;
+    string encabezado;
+
+    void porDefecto() {
+        columnas.clear();
+        agregar("ID", COL_ID);
+        Columna& nombre = agregar("Nombre", COL_POOL);
+        nombre.valores = {"Ana","Luis","Mica","Tomas","Sofia","Lucas","Valen","Agus","Cesar","Lauti"};
+        Columna& edad = agregar("Edad", COL_INT);
+        edad.a = 18;
+        edad.b = 78;
+        Columna& ciudad = agregar("Ciudad", COL_POOL);
+        ciudad.valores = {"Buenos Aires","Cordoba","Rosario","La Plata","Salta","Mendoza","Mar del Plata"};
+        agregar("Fuente", COL_GEN);
+        compilar();
+    }
+
+    // Lee el archivo de esquema. Devuelve false y deja el motivo en error.
+    bool cargar(const string& ruta, string& error) {
+        ifstream in(ruta);
+        if (!in) {
+            error = "no se pudo abrir " + ruta;
+            return false;
+        }
+        columnas.clear();
+        string linea;
+        for (int nro = 1; getline(in, linea); ++nro) {
+            if (!linea.empty() && linea.back() == '\r') linea.pop_back();
+            size_t ini = linea.find_first_not_of(" \t");
+            if (ini == string::npos || linea[ini] == '#') continue;
+            if (!cargarColumna(linea, ruta, error)) {
+                error = ruta + ":" + to_string(nro) + ": " + error;
+                return false;
+            }
+        }
+        int ids = 0;
+        for (const Columna& c : columnas) ids += c.tipo == COL_ID;
+        if (ids != 1) {
+            error = ruta + ": el esquema necesita exactamente una columna de tipo id";
+            return false;
+        }
+        compilar();
+        return true;
+    }
+
+    // Ancho máximo de una fila (sin '\n') para N generadores y total registros
+    size_t anchoFila(int N, int total) const {
+        size_t ancho = columnas.size() - 1; // comas
+        for (const Columna& c : columnas) {
+            switch (c.tipo) {
+            case COL_ID:         ancho += digitos(total); break;
+            case COL_INT:        ancho += std::max(digitos(c.a), digitos(c.b)); break;
+            case COL_SECUENCIAL: ancho += std::max(digitos(c.a), digitos(c.a + (total - 1LL) * c.b)); break;
+            case COL_UNICO:      ancho += c.prefijo.size() + UNICO_LARGO; break;
+            case COL_GEN:        ancho += 3 + digitos(N); break;
+            case COL_POOL: {
+                size_t m = 0;
+                for (string_view v : c.vistas) m = std::max(m, v.size());
+                ancho += m;
+                break;
+            }
+            }
+        }
+        return ancho;
+    }
+
+private:
+    Columna& agregar(const string& nombre, TipoColumna tipo) {
+        columnas.emplace_back();
+        columnas.back().nombre = nombre;
+        columnas.back().tipo = tipo;
+        return columnas.back();
+    }
+
+    bool cargarColumna(const string& linea, const string& ruta, string& error) {
+        size_t igual = linea.find('=');
+        istringstream def(linea.substr(0, igual));
+        string nombre, tipo, dist;
+        def >> nombre >> tipo;
+        if (tipo.empty()) {
+            error = "se esperaba '<nombre> <tipo> ...'";
+            return false;
         }
+        if (nombre.find_first_of(",\"") != string::npos) {
+            error = "el nombre de columna no puede tener comas ni comillas";
+            return false;
+        }
+
+        Columna& c = agregar(nombre, COL_ID);
+        if (tipo == "id") {
+            c.tipo = COL_ID;
+        } else if (tipo == "gen") {
+            c.tipo = COL_GEN;
+        } else if (tipo == "unico") {
+            c.tipo = COL_UNICO;
+            def >> c.prefijo;
+        } else if (tipo == "int") {
+            c.tipo = COL_INT;
+            def >> dist;
+            if (dist == "uniforme") {
+                if (!(def >> c.a >> c.b) || c.a > c.b
+                    || static_cast<unsigned long long>(c.b) - static_cast<unsigned long long>(c.a) >= (1ULL << 32) - 1) {
+                    error = "int uniforme necesita <mín> <máx> con un rango de hasta 2^32 - 1 valores";
+                    return false;
+                }
+            } else if (dist == "normal") {
+                double media, desvio;
+                if (!(def >> media >> desvio >> c.a >> c.b) || desvio <= 0 || c.a > c.b
+                    || static_cast<unsigned long long>(c.b) - static_cast<unsigned long long>(c.a) >= (1ULL << 20)) {
+                    error = "int normal necesita <media> <desvío> <mín> <máx> (desvío > 0, rango de hasta 2^20)";
+                    return false;
+                }
+                vector<double> pesos(static_cast<size_t>(c.b - c.a + 1));
+                for (size_t i = 0; i < pesos.size(); ++i) {
+                    double z = (c.a + static_cast<double>(i) - media) / desvio;
+                    pesos[i] = exp(-0.5 * z * z);
+                }
+                c.uniforme = false;
+                c.tabla.construir(pesos);
+            } else if (dist == "secuencial") {
+                c.tipo = COL_SECUENCIAL;
+                if (!(def >> c.a >> c.b)) {
+                    error = "int secuencial necesita <inicio> <paso>";
+                    return false;
+                }
+            } else {
+                error = "distribución de int desconocida: '" + dist + "' (uniforme, normal o secuencial)";
+                return false;
+            }
+        } else if (tipo == "pool") {
+            c.tipo = COL_POOL;
+            def >> dist;
+            if (igual == string::npos) {
+                error = "pool necesita '= v1,v2,...' o '= @archivo'";
+                return false;
+            }
+            vector<double> pesos;
+            if (!cargarValores(linea.substr(igual + 1), ruta, dist == "pesos", c.valores, pesos, error)) return false;
+            if (dist == "zipf") {
+                double exponente;
+                if (!(def >> exponente) || exponente <= 0) {
+                    error = "pool zipf necesita un exponente > 0";
+                    return false;
+                }
+                for (size_t k = 0; k < c.valores.size(); ++k) pesos.push_back(1.0 / pow(k + 1.0, exponente));
+            } else if (dist != "uniforme" && dist != "pesos") {
+                error = "distribución de pool desconocida: '" + dist + "' (uniforme, zipf o pesos)";
+                return false;
+            }
+            if (dist != "uniforme") {
+                c.uniforme = false;
+                c.tabla.construir(pesos);
+            }
+        } else {
+            error = "tipo desconocido: '" + tipo + "' (id, int, pool, unico o gen)";
+            return false;
+        }
+        return true;
+    }
+
+    // Valores de un pool: "v1,v2,..." o "@archivo" (uno por línea, relativo al
+    // esquema). Con conPesos cada valor va como "valor:peso".
+    static bool cargarValores(const string& texto, const string& rutaEsquema, bool conPesos,
+                              vector<string>& valores, vector<double>& pesos, string& error) {
+        auto recortar = [](string v) {
+            size_t i = v.find_first_not_of(" \t"), f = v.find_last_not_of(" \t\r");
+            return i == string::npos ? string() : v.substr(i, f - i + 1);
+        };
+        vector<string> crudos;
+        string t = recortar(texto);
+        if (!t.empty() && t[0] == '@') {
+            string ruta = t.substr(1);
+            size_t barra = rutaEsquema.rfind('/');
+            if (ruta[0] != '/' && barra != string::npos) ruta = rutaEsquema.substr(0, barra + 1) + ruta;
+            ifstream in(ruta);
+            if (!in) {
+                error = "no se pudo abrir " + ruta;
+                return false;
+            }
+            for (string v; getline(in, v); ) if (!recortar(v).empty()) crudos.push_back(recortar(v));
+        } else {
+            istringstream ss(t);
+            for (string v; getline(ss, v, ','); ) crudos.push_back(recortar(v));
+        }
+
+        for (string& v : crudos) {
+            if (conPesos) {
+                size_t dp = v.rfind(':');
+                double w = dp == string::npos ? -1 : atof(v.c_str() + dp + 1);
+                if (w <= 0) {
+                    error = "pool pesos: '" + v + "' no tiene la forma valor:peso con peso > 0";
+                    return false;
+                }
+                pesos.push_back(w);
+                v = recortar(v.substr(0, dp));
+            }
+            if (v.empty() || v.find_first_of(",\"\n") != string::npos || v.size() > 128) {
+                error = "valor de pool inválido: '" + v + "' (vacío, con comas/comillas o de más de 128 bytes)";
+                return false;
+            }
+            valores.push_back(std::move(v));
+        }
+        if (valores.empty() || valores.size() > UINT32_MAX) {
+            error = "el pool no tiene valores";
+            return false;
+        }
+        return true;
+    }
+
+    void compilar() {
+        encabezado.clear();
+        for (Columna& c : columnas) {
+            if (!encabezado.empty()) encabezado += ',';
+            encabezado += c.nombre;
+            c.vistas.assign(c.valores.begin(), c.valores.end());
+        }
+    }
+};
+
+static Esquema esquema; // se arma en main, antes del fork; los hijos lo heredan
+
+// Parte del ID mezclada de forma biyectiva en 32 bits y escrita en base 36 con
+// ancho fijo: distinta para cada ID pero sin pinta de secuencia.
+static char* escribirUnico(char* p, uint32_t x) {
+    static constexpr char base36[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    x *= 0x9E3779B1u;
+    x ^= x >> 15;
+    x *= 0x85EBCA77u;
+    x ^= x >> 13;
+    for (int i = UNICO_LARGO - 1; i >= 0; --i) {
+        p[i] = base36[x % 36];
+        x /= 36;
+    }
+    return p + UNICO_LARGO;
+}
+
+// Sorteos de cada tipo de columna; los usan tanto el CSV como --formato
+// binario, así con la misma semilla ambos tienen los mismos datos.
+// El rango uniforme tiene como mucho 2^32 - 1 valores, así que b - a + 1 entra en uint32_t sin dar 0
+static long long sortearInt(const Columna& c, Xoshiro256& rng) {
+    return c.a + static_cast<long long>(c.uniforme ? rng.rango(static_cast<uint32_t>(c.b - c.a + 1)) : c.tabla.sortear(rng));
+}
+
+static uint32_t sortearPool(const Columna& c, Xoshiro256& rng) {
+    return c.uniforme ? rng.rango(static_cast<uint32_t>(c.vistas.size())) : c.tabla.sortear(rng);
+}
 
-        int start = shm->next_id;
-        int remain = shm->total_registros - shm->next_id + 1;
-        if (remain <= 0) {
-            sem_signal_idx(semid, SEM_MUTEX);
+// Formatea la fila directamente en buf (al menos REG_MAX bytes) sin reservar
+// memoria. Devuelve el largo, sin '\n'.
+static size_t formatearRegistro(char* buf, int id, int idHijo, Xoshiro256& rng) {
+    char* fin = buf + REG_MAX;
+    char* p = buf;
+
+    for (const Columna& c : esquema.columnas) {
+        if (p != buf) *p++ = ',';
+        switch (c.tipo) {
+        case COL_ID:
+            p = to_chars(p, fin, id).ptr;
+            break;
+        case COL_INT:
+            p = to_chars(p, fin, sortearInt(c, rng)).ptr;
+            break;
+        case COL_SECUENCIAL:
+            p = to_chars(p, fin, c.a + (id - 1LL) * c.b).ptr;
+            break;
+        case COL_POOL:
+            p = copiar(p, c.vistas[sortearPool(c, rng)]);
             break;
+        case COL_UNICO:
+            p = escribirUnico(copiar(p, c.prefijo), static_cast<uint32_t>(id));
+            break;
+        case COL_GEN:
+            p = to_chars(copiar(p, "Gen"), fin, idHijo).ptr;
+            break;
+        }
+    }
+    return static_cast<size_t>(p - buf);
+}
+
+// Bloque de registros ya formateados por un generador
+struct Bloque {
+    int start = 0;
+    int n = 0;
+    int largos[BLOQUE_MAX];
+    char lineas[BLOQUE_MAX][REG_MAX];
+};
+
+// ------------------------------ Salida directa -------------------------------
+// Modo --directo: el archivo se dimensiona de antemano y se mapea con
+// MAP_SHARED antes del fork. Todas las filas ocupan exactamente ancho_ bytes,
+// así que la fila del ID i empieza en encabezado + (i-1)*ancho_ y cada
+// generador escribe sus IDs en su lugar sin pasar por el coordinador. La
+// salida queda ordenada por ID. El relleno son saltos de línea (líneas vacías,
+// que los lectores de CSV saltean), así ningún campo cambia.
+class SalidaDirecta {
+public:
+    ~SalidaDirecta() {
+        if (mapa_) munmap(mapa_, tam_);
+        if (fd_ != -1) close(fd_);
+    }
+
+    // anchoFila incluye el '\n' final
+    bool abrir(const string& ruta, const char* encabezado, int total, size_t anchoFila) {
+        encabezado_ = strlen(encabezado) + 1;
+        ancho_ = anchoFila;
+        tam_ = encabezado_ + static_cast<size_t>(total) * ancho_;
+
+        fd_ = open(ruta.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ == -1) return false;
+        if (ftruncate(fd_, static_cast<off_t>(tam_)) == -1) return false;
+        void* m = mmap(nullptr, tam_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (m == MAP_FAILED) return false;
+        mapa_ = static_cast<char*>(m);
+
+        memcpy(mapa_, encabezado, encabezado_ - 1);
+        mapa_[encabezado_ - 1] = '\n';
+        return true;
+    }
+
+    // Devuelve false, sin escribir nada, si la fila no entra en el ancho
+    bool escribirFila(int id, const char* linea, size_t len) {
+        if (len > ancho_ - 1) return false;
+        char* fila = mapa_ + encabezado_ + static_cast<size_t>(id - 1) * ancho_;
+        memcpy(fila, linea, len);
+        memset(fila + len, '\n', ancho_ - len);
+        return true;
+    }
+
+    bool cerrar() {
+        bool ok = msync(mapa_, tam_, MS_SYNC) == 0;
+        ok = munmap(mapa_, tam_) == 0 && ok;
+        mapa_ = nullptr;
+        ok = close(fd_) == 0 && ok;
+        fd_ = -1;
+        return ok;
+    }
+
+    size_t bytes() const { return tam_; }
+
+private:
+    int fd_ = -1;
+    char* mapa_ = nullptr;
+    size_t tam_ = 0, encabezado_ = 0, ancho_ = 0;
+};
+
+static SalidaDirecta* salidaDirecta = nullptr; // no nulo en modo --directo (lo heredan los hijos)
+
+// ------------------------------ Salida binaria -------------------------------
+// Modo --formato binario: snapshot columnar que el servidor mapea con mmap sin
+// parsear texto. Igual que --directo, el archivo se dimensiona de antemano y
+// cada generador escribe sus IDs en su lugar. Layout (little-endian, el de
+// la máquina; tiene que coincidir con ejercicio02/server.cpp):
+//
+//   CabeceraSnap | ColumnaSnap[columnas] | diccionarios | datos por columna
+//
+// El valor de la columna c para el ID i está en offsetDatos + (i-1)*ancho:
+// int32/int64, código uint32 del diccionario (pool y Fuente) o texto de ancho
+// fijo relleno con '\0' (unico). Un diccionario es uint32 fin[nDicc] (offset
+// acumulado de cada texto) seguido de los textos concatenados.
+static constexpr char SNAP_MAGIC[8] = {'T', 'P', 'S', 'N', 'A', 'P', '\r', '\n'};
+#define SNAP_VERSION 1
+enum TipoSnap : uint32_t { SNAP_INT32 = 1, SNAP_INT64 = 2, SNAP_DICC = 3, SNAP_TEXTO = 4 };
+
+struct CabeceraSnap {
+    char magic[8];
+    uint32_t version;
+    uint32_t columnas;
+    uint64_t filas;
+    uint64_t bytes;          // tamaño total del archivo
+    uint64_t offsetColumnas; // ColumnaSnap[columnas]
+    char reservado[24];
+};
+
+struct ColumnaSnap {
+    char nombre[32];
+    uint32_t tipo;           // TipoSnap
+    uint32_t ancho;          // bytes por fila
+    uint64_t offsetDatos;
+    uint64_t offsetDicc;     // solo SNAP_DICC
+    uint32_t nDicc;
+    uint32_t reservado;
+};
+static_assert(sizeof(CabeceraSnap) == 64 && sizeof(ColumnaSnap) == 64, "layout del snapshot");
+
+class SalidaBinaria {
+public:
+    ~SalidaBinaria() {
+        if (mapa_) munmap(mapa_, tam_);
+        if (fd_ != -1) close(fd_);
+    }
+
+    bool abrir(const string& ruta, const Esquema& e, int N, int total) {
+        // Tipo, ancho y diccionario de cada columna
+        size_t nc = e.columnas.size();
+        vector<ColumnaSnap> desc(nc);
+        vector<vector<string>> diccs(nc);
+        for (size_t k = 0; k < nc; ++k) {
+            const Columna& c = e.columnas[k];
+            ColumnaSnap& d = desc[k];
+            memset(&d, 0, sizeof(d));
+            strncpy(d.nombre, c.nombre.c_str(), sizeof(d.nombre) - 1);
+            long long lo = 1, hi = total;
+            switch (c.tipo) {
+            case COL_ID:         break;
+            case COL_INT:        lo = c.a; hi = c.b; break;
+            case COL_SECUENCIAL: lo = std::min(c.a, c.a + (total - 1LL) * c.b);
+                                 hi = std::max(c.a, c.a + (total - 1LL) * c.b); break;
+            case COL_POOL:       diccs[k] = c.valores; break;
+            case COL_GEN:
+                for (int g = 1; g <= N; ++g) diccs[k].push_back("Gen" + to_string(g));
+                break;
+            case COL_UNICO:      break;
+            }
+            if (c.tipo == COL_POOL || c.tipo == COL_GEN) {
+                d.tipo = SNAP_DICC;
+                d.ancho = sizeof(uint32_t);
+                d.nDicc = static_cast<uint32_t>(diccs[k].size());
+            } else if (c.tipo == COL_UNICO) {
+                d.tipo = SNAP_TEXTO;
+                d.ancho = static_cast<uint32_t>(c.prefijo.size() + UNICO_LARGO);
+            } else {
+                bool entra32 = lo >= INT32_MIN && hi <= INT32_MAX;
+                d.tipo = entra32 ? SNAP_INT32 : SNAP_INT64;
+                d.ancho = entra32 ? sizeof(int32_t) : sizeof(int64_t);
+            }
+        }
+
+        // Offsets: cabecera, descriptores, diccionarios y columnas alineadas a 64
+        auto alinear = [](size_t v) { return (v + 63) & ~static_cast<size_t>(63); };
+        size_t off = sizeof(CabeceraSnap) + nc * sizeof(ColumnaSnap);
+        for (size_t k = 0; k < nc; ++k) {
+            if (desc[k].tipo != SNAP_DICC) continue;
+            off = alinear(off);
+            desc[k].offsetDicc = off;
+            off += sizeof(uint32_t) * diccs[k].size();
+            for (const string& v : diccs[k]) off += v.size();
+        }
+        for (size_t k = 0; k < nc; ++k) {
+            off = alinear(off);
+            desc[k].offsetDatos = off;
+            off += static_cast<size_t>(total) * desc[k].ancho;
+        }
+        tam_ = off;
+
+        fd_ = open(ruta.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ == -1) return false;
+        if (ftruncate(fd_, static_cast<off_t>(tam_)) == -1) return false;
+        void* m = mmap(nullptr, tam_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (m == MAP_FAILED) return false;
+        mapa_ = static_cast<char*>(m);
+
+        CabeceraSnap cab;
+        memset(&cab, 0, sizeof(cab));
+        memcpy(cab.magic, SNAP_MAGIC, sizeof(cab.magic));
+        cab.version = SNAP_VERSION;
+        cab.columnas = static_cast<uint32_t>(nc);
+        cab.filas = static_cast<uint64_t>(total);
+        cab.bytes = tam_;
+        cab.offsetColumnas = sizeof(CabeceraSnap);
+        memcpy(mapa_, &cab, sizeof(cab));
+        memcpy(mapa_ + cab.offsetColumnas, desc.data(), nc * sizeof(ColumnaSnap));
+
+        for (size_t k = 0; k < nc; ++k) {
+            if (desc[k].tipo != SNAP_DICC) continue;
+            uint32_t* fin = reinterpret_cast<uint32_t*>(mapa_ + desc[k].offsetDicc);
+            char* texto = reinterpret_cast<char*>(fin + diccs[k].size());
+            uint32_t acum = 0;
+            for (size_t v = 0; v < diccs[k].size(); ++v) {
+                memcpy(texto + acum, diccs[k][v].data(), diccs[k][v].size());
+                acum += static_cast<uint32_t>(diccs[k][v].size());
+                fin[v] = acum;
+            }
+        }
+
+        destinos_.clear();
+        for (const ColumnaSnap& d : desc) destinos_.push_back({mapa_ + d.offsetDatos, d.ancho});
+        return true;
+    }
+
+    // Escribe la fila del ID en cada columna, con los mismos sorteos que formatearRegistro
+    void escribirFila(int id, int idHijo, Xoshiro256& rng) const {
+        size_t fila = static_cast<size_t>(id - 1);
+        for (size_t k = 0; k < destinos_.size(); ++k) {
+            const Columna& c = esquema.columnas[k];
+            char* dst = destinos_[k].base + fila * destinos_[k].ancho;
+            switch (c.tipo) {
+            case COL_ID:         guardarEntero(dst, destinos_[k].ancho, id); break;
+            case COL_INT:        guardarEntero(dst, destinos_[k].ancho, sortearInt(c, rng)); break;
+            case COL_SECUENCIAL: guardarEntero(dst, destinos_[k].ancho, c.a + (id - 1LL) * c.b); break;
+            case COL_POOL:       guardarCodigo(dst, sortearPool(c, rng)); break;
+            case COL_GEN:        guardarCodigo(dst, static_cast<uint32_t>(idHijo - 1)); break;
+            case COL_UNICO:      escribirUnico(copiar(dst, c.prefijo), static_cast<uint32_t>(id)); break;
+            }
+        }
+    }
+
+    bool cerrar() {
+        bool ok = msync(mapa_, tam_, MS_SYNC) == 0;
+        ok = munmap(mapa_, tam_) == 0 && ok;
+        mapa_ = nullptr;
+        ok = close(fd_) == 0 && ok;
+        fd_ = -1;
+        return ok;
+    }
+
+    size_t bytes() const { return tam_; }
+
+private:
+    struct Destino {
+        char* base;
+        uint32_t ancho;
+    };
+
+    static void guardarEntero(char* dst, uint32_t ancho, long long v) {
+        if (ancho == sizeof(int32_t)) {
+            int32_t x = static_cast<int32_t>(v);
+            memcpy(dst, &x, sizeof(x));
+        } else {
+            int64_t x = v;
+            memcpy(dst, &x, sizeof(x));
         }
+    }
+
+    static void guardarCodigo(char* dst, uint32_t codigo) { memcpy(dst, &codigo, sizeof(codigo)); }
+
+    int fd_ = -1;
+    char* mapa_ = nullptr;
+    size_t tam_ = 0;
+    vector<Destino> destinos_;
+};
+
+static SalidaBinaria* salidaBinaria = nullptr; // no nulo en --formato binario (lo heredan los hijos)
+
+// Los generadores escriben directo en el archivo mapeado (--directo o binario)
+static bool salidaMapeada() { return salidaDirecta || salidaBinaria; }
+
+// Ancho fijo de fila para N generadores y total registros: cada columna a su
+// largo máximo posible según el esquema, las comas y el '\n'.
+static size_t anchoFilaMaximo(int N, int total) {
+    return esquema.anchoFila(N, total) + 1;
+}
+
+// --------------------------- Proceso Generador -------------------------------
+static long ahoraNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Reserva el próximo bloque de IDs. Devuelve false si ya no queda nada por generar.
+// La reserva es un compare-and-swap sobre next_id, sin semáforos. Se pide
+// `deseado` IDs, pero cerca del final el bloque baja a lo que queda / (2N)
+// para que los últimos IDs se repartan parejo entre todos los generadores.
+// También con --semilla: el contenido de cada ID no depende del reparto
+// (ver rngFila y fuenteDe).
+static bool reservarBloque(int N, int deseado, int& start, int& block) {
+    if (shm->terminar.load()) return false;
 
-        int block = std::min(10, remain); // Usar std::min
-        shm->next_id += block;  // reservar los 10 IDs
+    int actual = shm->next_id.load(memory_order_relaxed);
+    do {
+        int remain = shm->total_registros - actual + 1;
+        if (remain <= 0) return false;
+        block = std::min(deseado, std::max(1, remain / (2 * N)));
+        block = std::min(block, remain);
+    } while (!shm->next_id.compare_exchange_weak(actual, actual + block, memory_order_relaxed));
+
+    start = actual;
+    return true;
+}
+
+// Ajusta el tamaño de bloque a la velocidad medida en el último (media móvil)
+static int ajustarBloque(int actual, int generados, long ns) {
+    if (ns <= 0) return BLOQUE_MAX;
+    long ideal = static_cast<long>(generados) * BLOQUE_OBJETIVO_NS / ns;
+    long nuevo = (actual + ideal) / 2;
+    return static_cast<int>(std::max<long>(BLOQUE_MIN, std::min<long>(BLOQUE_MAX, nuevo)));
+}
+
+// Modo semáforos: publicar el bloque en el anillo común, de a lo sumo K por vez
+static void publicarBloqueSemaforos(const Bloque& b, EstadGenerador& est) {
+    Slot* slots = slotsDe(shm);
+    for (int hecho = 0; hecho < b.n; ) {
+        int n = std::min<int>(b.n - hecho, shm->capacidad);
+
+        // PASO 1: Reservar n slots libres con un único semop
+        long t0 = ahoraNs();
+        sem_op_n(semid, SEM_EMPTY_SLOT, -n);
+        long t1 = ahoraNs();
+        sumar(est.nsEsperaSlots, t1 - t0);
+        if (shm->terminar.load()) break; // despertado solo para terminar
+
+        // PASO 2: Copiar los registros en los slots reservados
+        sem_wait_idx(semid, SEM_MUTEX);
+        sumar(est.nsEsperaMutex, ahoraNs() - t1);
+        for (int i = 0; i < n; ++i) {
+            Slot& slot = slots[(shm->head.load(memory_order_relaxed) + i) % shm->capacidad];
+            memcpy(slot.registro, b.lineas[hecho + i], b.largos[hecho + i]);
+            slot.largo = b.largos[hecho + i];
+            slot.id_publicado = b.start + hecho + i;
+        }
+        shm->head.store(shm->head.load(memory_order_relaxed) + n, memory_order_release);
         sem_signal_idx(semid, SEM_MUTEX);
 
-        // Generar y publicar cada ID del bloque
-        for (int i = 0; i < block; ++i) {
-            int id = start + i;
-            if (id > shm->total_registros) break;
+        // PASO 3: Avisar al coordinador que hay n registros más disponibles
+        sem_op_n(semid, SEM_FULL_SLOT, n);
+        hecho += n;
+    }
+}
 
-            string reg = generarRegistroAleatorio(id, idHijo);
+// Modo SPSC: avisar al coordinador que hay datos nuevos. El fetch_add y la
+// lectura de coordDurmiendo son seq_cst, igual que del lado del coordinador,
+// así que o bien él ve el nuevo coordSeq antes de dormir o bien nosotros lo
+// vemos dormido y lo despertamos.
+static void avisarCoordinador() {
+    shm->coordSeq.fetch_add(1);
+    if (shm->coordDurmiendo.load()) futex_wake(&shm->coordSeq);
+}
 
-            // Publicar en la SHM
-            // PASO 1: Esperar a que el slot compartido esté vacío
-            sem_wait_idx(semid, SEM_EMPTY_SLOT);
+// Modo SPSC: publicar el bloque en el anillo propio del generador
+static void publicarBloqueSPSC(AnilloSPSC& a, Slot* slots, const Bloque& b, EstadGenerador& est) {
+    const uint32_t cap = shm->capacidad;
+    uint32_t head = a.head.load(memory_order_relaxed);
 
-            // PASO 2: Proteger la escritura en el slot compartido con el mutex
-            sem_wait_idx(semid, SEM_MUTEX);
-            strncpy(shm->registro, reg.c_str(), sizeof(shm->registro) - 1);
-            shm->registro[sizeof(shm->registro) - 1] = '\0';
-            shm->id_publicado = id;
-            // shm->nuevoRegistro ya no se usa
-            sem_signal_idx(semid, SEM_MUTEX);
+    for (int i = 0; i < b.n; ++i) {
+        // Anillo lleno: publicar lo ya escrito y dormir hasta que el coordinador libere espacio
+        while (head - a.tail.load(memory_order_acquire) == cap) {
+            a.head.store(head, memory_order_release);
+            avisarCoordinador();
 
-            // PASO 3: Avisar al coordinador que hay un nuevo registro disponible (el slot está lleno)
-            sem_signal_idx(semid, SEM_FULL_SLOT);
+            long t0 = ahoraNs();
+            a.prodDurmiendo.store(1);
+            uint32_t t = a.tail.load();
+            if (head - t == cap && !shm->terminar.load()) futex_wait(&a.tail, t);
+            a.prodDurmiendo.store(0);
+            sumar(est.nsEsperaSlots, ahoraNs() - t0);
+            if (shm->terminar.load()) return;
+        }
 
-            // La lógica de espera de "consumido" ya no es necesaria aquí;
-            // SEM_EMPTY_SLOT se encarga de que no se sobrescriba antes de consumir.
+        Slot& slot = slots[head % cap];
+        memcpy(slot.registro, b.lineas[i], b.largos[i]);
+        slot.largo = b.largos[i];
+        slot.id_publicado = b.start + i;
+        ++head;
+    }
+
+    // Un solo store + aviso por bloque
+    a.head.store(head, memory_order_release);
+    avisarCoordinador();
+}
+
+// Cuerpo de un generador; lo corre un proceso hijo o un hilo según el motor
+static void generar(int idHijo, int N) {
+    Xoshiro256 rng(semillaGenerador(idHijo));
+    unique_ptr<Bloque> bloque(new Bloque); // REG_MAX * BLOQUE_MAX no va al stack
+    Bloque& b = *bloque;
+    EstadGenerador& est = estadDe(shm)[idHijo - 1];
+
+    int deseado = BLOQUE_MIN;
+    while (reservarBloque(N, deseado, b.start, b.n)) {
+        long t0 = ahoraNs();
+
+        if (salidaBinaria) {
+            // Binario: cada valor va directo a su columna, sin pasar por texto
+            for (int i = 0; i < b.n; ++i) {
+                int id = b.start + i;
+                salidaBinaria->escribirFila(id, fuenteDe(id, idHijo, N), rngFila(rng, id));
+            }
+            sumar(est.registros, b.n);
+            deseado = ajustarBloque(deseado, b.n, ahoraNs() - t0);
+            continue;
+        }
+
+        // Generar el bloque completo fuera de la sección crítica
+        for (int i = 0; i < b.n; ++i) {
+            int id = b.start + i;
+            b.largos[i] = static_cast<int>(formatearRegistro(b.lineas[i], id, fuenteDe(id, idHijo, N), rngFila(rng, id)));
         }
 
-        usleep(50000); // pequeña pausa entre bloques
+        if (salidaDirecta) {
+            for (int i = 0; i < b.n; ++i) {
+                if (!salidaDirecta->escribirFila(b.start + i, b.lineas[i], b.largos[i])) shm->filasLargas.fetch_add(1);
+            }
+        } else if (modoIPC == IPC_SPSC) {
+            publicarBloqueSPSC(anillosDe(shm)[idHijo - 1], slotsAnilloDe(shm, N, idHijo - 1), b, est);
+        } else {
+            publicarBloqueSemaforos(b, est);
+        }
+        sumar(est.registros, b.n);
+
+        deseado = ajustarBloque(deseado, b.n, ahoraNs() - t0);
     }
 
-    // Al terminar, reducir el contador de generadores activos
-    sem_wait_idx(semid, SEM_MUTEX);
-    shm->generadoresActivos--;
-    sem_signal_idx(semid, SEM_MUTEX);
+    // Al terminar, reducir el contador de generadores activos. El último en
+    // salir deja un aviso extra en SEM_FULL_SLOT para despertar al coordinador;
+    // como cada uno publica antes de decrementar, ese aviso llega después de
+    // todos los registros.
+    if (shm->generadoresActivos.fetch_sub(1) == 1 && modoIPC == IPC_SEMAFOROS && !salidaMapeada()) {
+        sem_signal_idx(semid, SEM_FULL_SLOT);
+    }
 
+    if (modoIPC == IPC_SPSC && !salidaMapeada()) {
+        anillosDe(shm)[idHijo - 1].terminado.store(1, memory_order_release);
+        avisarCoordinador();
+    }
+}
+
+static void procesoGenerador(int idHijo, int N) {
+    generar(idHijo, N);
     _exit(0);
 }
 
 // ------------------------------- Coordinador ---------------------------------
-static int runCoordinador(int N, int total, const string& rutaCSV) {
-    // Crear el archivo CSV y escribir encabezado
-    ofstream csv(rutaCSV, ios::out | ios::trunc);
-    if (!csv) {
-        cerr << "ERROR: No se pudo abrir el archivo de salida: " << rutaCSV << "\n";
-        return 1;
+// Motor de ejecución de los generadores
+enum Motor {
+    MOTOR_PROCESOS, // fork + memoria compartida SysV
+    MOTOR_HILOS     // std::thread dentro del mismo proceso
+};
+
+struct Opciones {
+    int N = 0;
+    int total = 0;
+    string rutaCSV;
+    int K = SLOTS_DEFAULT;
+    PoliticaFlush politica;
+    int ventanaOrden = 0; // 0 = salida en orden de llegada
+    bool directo = false;  // los generadores escriben en el archivo mapeado
+    bool binario = false;  // --formato binario (implica directo)
+    Motor motor = MOTOR_PROCESOS;
+    bool batch = false;    // sin pausa interactiva al final
+    long metricasMs = 0;   // intervalo de métricas en vivo (0 = no)
+    string rutaJSON;       // volcar las métricas finales en JSON
+};
+
+// Hilo del coordinador que imprime el avance cada intervalo en stderr. Lee
+// solo contadores atómicos, así que no frena a nadie.
+class MonitorVivo {
+public:
+    MonitorVivo(const Opciones& op, const EscritorCSV& csv) : op_(op), csv_(csv) {}
+
+    void iniciar() {
+        if (op_.metricasMs <= 0) return;
+        inicio_ = ahoraNs();
+        hilo_ = thread([this] { correr(); });
     }
-    csv << "ID,Nombre,Edad,Ciudad,Fuente\n";
-    csv.flush();
 
-    // Crear memoria compartida
-    shmid = shmget(SHM_KEY, sizeof(SharedData), IPC_CREAT | 0666);
-    if (shmid == -1) {
-        perror("shmget");
-        return 1;
+    void detener() {
+        if (!hilo_.joinable()) return;
+        {
+            lock_guard<mutex> lk(m_);
+            fin_ = true;
+        }
+        cv_.notify_one();
+        hilo_.join();
     }
 
-    shm = (SharedData*)shmat(shmid, nullptr, 0);
-    if (shm == (void*)-1) {
-        perror("shmat");
-        return 1;
+private:
+    void correr() {
+        uint64_t anterior = 0;
+        long tAnterior = inicio_;
+        unique_lock<mutex> lk(m_);
+        while (!cv_.wait_for(lk, chrono::milliseconds(op_.metricasMs), [this] { return fin_; })) {
+            long ahora = ahoraNs();
+            uint64_t generados = 0;
+            for (int g = 0; g < op_.N; ++g) generados += estadDe(shm)[g].registros.load(memory_order_relaxed);
+            double dt = (ahora - tAnterior) / 1e9;
+            double espera = estadCoord.nsEsperaDatos.load(memory_order_relaxed) / 1e9;
+            uint64_t escritos = static_cast<uint64_t>(shm->total_escritos.load());
+            double mb = csv_.bytesEscritos() / 1e6;
+            if (salidaMapeada()) {
+                // El coordinador no ve los datos: cada generador escribe en su lugar
+                // lo que genera, así que el avance sale de sus contadores
+                size_t tam = salidaDirecta ? salidaDirecta->bytes() : salidaBinaria->bytes();
+                escritos = generados;
+                mb = static_cast<double>(tam) * generados / op_.total / 1e6;
+            }
+            fprintf(stderr, "[%7.1fs] generados %llu/%d (%.1f%%)  %.0f reg/s  escritos %llu  %.1f MB  coord. esperando %.1fs\n",
+                    (ahora - inicio_) / 1e9, static_cast<unsigned long long>(generados), op_.total,
+                    100.0 * generados / op_.total, (generados - anterior) / std::max(dt, 1e-9),
+                    static_cast<unsigned long long>(escritos), mb, espera);
+            anterior = generados;
+            tAnterior = ahora;
+        }
+    }
+
+    const Opciones& op_;
+    const EscritorCSV& csv_;
+    thread hilo_;
+    mutex m_;
+    condition_variable cv_;
+    bool fin_ = false;
+    long inicio_ = 0;
+};
+
+// Resumen final de métricas; en texto por stdout y opcionalmente en JSON
+static bool reportarMetricas(const Opciones& op, long nsTotal, long nsArranque, uint64_t bytes) {
+    double seg = std::max(nsTotal, 1L) / 1e9;
+    uint64_t tandas = estadCoord.tandas.load();
+    double mediaTandaUs = tandas ? estadCoord.nsTandas.load() / 1e3 / tandas : 0.0;
+
+    cout << "\n📊 Métricas\n"
+         << "   Coordinador: esperando datos " << estadCoord.nsEsperaDatos.load() / 1000000 << " ms, "
+         << tandas << " tandas, latencia media " << mediaTandaUs << " us, p99 <= "
+         << percentilTanda(0.99) / 1000 << " us, máx " << estadCoord.nsTandaMax.load() / 1000 << " us\n";
+    for (int g = 0; g < op.N; ++g) {
+        const EstadGenerador& e = estadDe(shm)[g];
+        cout << "   Gen" << (g + 1) << ": " << e.registros.load() << " registros ("
+             << static_cast<long>(e.registros.load() / seg) << " reg/s), esperando slots "
+             << e.nsEsperaSlots.load() / 1000000 << " ms, mutex " << e.nsEsperaMutex.load() / 1000000 << " ms\n";
+    }
+
+    if (op.rutaJSON.empty()) return true;
+    FILE* f = fopen(op.rutaJSON.c_str(), "w");
+    if (!f) {
+        perror(("fopen " + op.rutaJSON).c_str());
+        return false;
+    }
+    fprintf(f, "{\n  \"generadores\": %d,\n  \"motor\": \"%s\",\n  \"transporte\": \"%s\",\n",
+            op.N, op.motor == MOTOR_HILOS ? "hilos" : "procesos",
+            op.binario ? "binario" : op.directo ? "directo" : (modoIPC == IPC_SPSC ? "spsc" : "sem"));
+    fprintf(f, "  \"slots\": %d,\n  \"ordenado\": %s,\n  \"registros\": %d,\n",
+            op.K, op.ventanaOrden > 0 ? "true" : "false", op.total);
+    fprintf(f, "  \"segundos\": %.6f,\n  \"arranque_us\": %ld,\n  \"registros_por_segundo\": %.1f,\n  \"bytes_escritos\": %llu,\n",
+            seg, nsArranque / 1000, op.total / seg, static_cast<unsigned long long>(bytes));
+    fprintf(f, "  \"coordinador\": {\"espera_datos_ms\": %.3f, \"tandas\": %llu, \"latencia_tanda_us\": "
+               "{\"media\": %.3f, \"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f}},\n",
+            estadCoord.nsEsperaDatos.load() / 1e6, static_cast<unsigned long long>(tandas), mediaTandaUs,
+            percentilTanda(0.50) / 1e3, percentilTanda(0.99) / 1e3, estadCoord.nsTandaMax.load() / 1e3);
+    fprintf(f, "  \"por_generador\": [\n");
+    for (int g = 0; g < op.N; ++g) {
+        const EstadGenerador& e = estadDe(shm)[g];
+        fprintf(f, "    {\"id\": %d, \"registros\": %llu, \"registros_por_segundo\": %.1f, "
+                   "\"espera_slots_ms\": %.3f, \"espera_mutex_ms\": %.3f}%s\n",
+                g + 1, static_cast<unsigned long long>(e.registros.load()), e.registros.load() / seg,
+                e.nsEsperaSlots.load() / 1e6, e.nsEsperaMutex.load() / 1e6, g + 1 < op.N ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+// Modo semáforos: consumir del anillo común hasta que todo esté escrito.
+// Bloquea en SEM_FULL_SLOT; no hay sondeo periódico.
+static void consumirSemaforos(Salida& salida) {
+    Slot* slots = slotsDe(shm);
+
+    while (true) {
+        // Esperar a que haya al menos un registro (o el aviso de fin)
+        long t0 = ahoraNs();
+        sem_wait_idx(semid, SEM_FULL_SLOT);
+        long t1 = ahoraNs();
+        sumar(estadCoord.nsEsperaDatos, t1 - t0);
+
+        // Tomar de una vez todos los demás avisos ya publicados. Como el
+        // coordinador es el único que decrementa SEM_FULL_SLOT, GETVAL es una
+        // cota inferior segura y el semop siguiente no puede bloquear.
+        int n = 1;
+        int extra = semctl(semid, SEM_FULL_SLOT, GETVAL);
+        if (extra > 0) {
+            sembuf op_full_n = {SEM_FULL_SLOT, static_cast<short>(-extra), IPC_NOWAIT};
+            if (semop(semid, &op_full_n, 1) == 0) n += extra;
+        }
+
+        // PASO 1: Volcar hasta n slots desde tail. Si hay menos publicados que
+        // avisos, el sobrante es el aviso de fin del último generador. No hace
+        // falta el mutex: esos slots ya están publicados y ningún productor los
+        // toca hasta que se liberen en SEM_EMPTY_SLOT.
+        unsigned disponibles = shm->head.load(memory_order_acquire) - shm->tail;
+        unsigned leer = std::min<unsigned>(n, disponibles);
+        for (unsigned i = 0; i < leer; ++i) {
+            const Slot& slot = slots[(shm->tail + i) % shm->capacidad];
+            salida.registro(slot.id_publicado, slot.registro, slot.largo);
+        }
+        shm->tail += leer;
+        shm->total_escritos += leer;
+
+        // PASO 2: Devolver los slots a los productores
+        if (leer > 0) sem_op_n(semid, SEM_EMPTY_SLOT, leer);
+        salida.csv.finDeTanda();
+        if (leer > 0) registrarTanda(ahoraNs() - t1);
+
+        // Todos los generadores terminaron y no queda nada publicado
+        if (shm->generadoresActivos.load() == 0 &&
+            shm->tail == shm->head.load(memory_order_acquire)) {
+            break;
+        }
+    }
+}
+
+// Modo SPSC: recorrer los N anillos drenando todo lo publicado en cada uno.
+// Solo se duerme (futex en coordSeq) cuando una pasada completa no encontró nada.
+static void consumirSPSC(Salida& salida, int N) {
+    AnilloSPSC* anillos = anillosDe(shm);
+    const uint32_t cap = shm->capacidad;
+
+    while (true) {
+        uint32_t seq = shm->coordSeq.load();
+        uint32_t drenados = 0;
+        long t0 = ahoraNs();
+        bool todosTerminaron = true;
+
+        for (int g = 0; g < N; ++g) {
+            AnilloSPSC& a = anillos[g];
+            // Leer terminado ANTES que head: si ya terminó, el head leído es el final
+            bool fin = a.terminado.load(memory_order_acquire);
+            uint32_t h = a.head.load(memory_order_acquire);
+            uint32_t t = a.tail.load(memory_order_relaxed);
+
+            if (h != t) {
+                Slot* slots = slotsAnilloDe(shm, N, g);
+                for (uint32_t i = t; i != h; ++i) {
+                    const Slot& slot = slots[i % cap];
+                    salida.registro(slot.id_publicado, slot.registro, slot.largo);
+                }
+                drenados += h - t;
+                a.tail.store(h);
+                if (a.prodDurmiendo.load()) futex_wake(&a.tail);
+            }
+            if (!fin) todosTerminaron = false;
+        }
+
+        if (drenados > 0) {
+            shm->total_escritos += drenados;
+            salida.csv.finDeTanda();
+            registrarTanda(ahoraNs() - t0);
+        }
+        if (todosTerminaron || shm->terminar.load()) break;
+
+        if (drenados == 0) {
+            long t1 = ahoraNs();
+            shm->coordDurmiendo.store(1);
+            if (shm->coordSeq.load() == seq) futex_wait(&shm->coordSeq, seq);
+            shm->coordDurmiendo.store(0);
+            sumar(estadCoord.nsEsperaDatos, ahoraNs() - t1);
+        }
+    }
+}
+
+static int runCoordinador(const Opciones& op) {
+    const int N = op.N, total = op.total, K = op.K, ventanaOrden = op.ventanaOrden;
+    const string& rutaCSV = op.rutaCSV;
+    const bool directo = op.directo;
+    const bool hilos = op.motor == MOTOR_HILOS;
+    long tInicio = ahoraNs();
+
+    // Crear el archivo CSV y escribir encabezado (nombres de columna del esquema)
+    const char* encabezado = esquema.encabezado.c_str();
+    EscritorCSV csv;
+    SalidaDirecta directa;
+    SalidaBinaria binaria;
+    if (op.binario) {
+        if (!binaria.abrir(rutaCSV, esquema, N, total)) {
+            perror(("ERROR: No se pudo preparar el archivo de salida " + rutaCSV).c_str());
+            return 1;
+        }
+        salidaBinaria = &binaria;
+    } else if (directo) {
+        if (!directa.abrir(rutaCSV, encabezado, total, anchoFilaMaximo(N, total))) {
+            perror(("ERROR: No se pudo preparar el archivo de salida " + rutaCSV).c_str());
+            return 1;
+        }
+        salidaDirecta = &directa;
+    } else {
+        if (!csv.abrir(rutaCSV, op.politica)) {
+            cerr << "ERROR: No se pudo abrir el archivo de salida: " << rutaCSV << "\n";
+            return 1;
+        }
+        csv.escribir(encabezado, esquema.encabezado.size());
+    }
+
+    // Modo --ordenado: reordenador con ventana acotada (--directo ya sale ordenado)
+    ReordenadorIDs* reorden = nullptr;
+    if (ventanaOrden > 0 && !directo) {
+        reorden = new ReordenadorIDs(csv, ventanaOrden);
+        if (!reorden->abrir(rutaCSV)) {
+            perror("mkstemp (archivo de desborde)");
+            delete reorden;
+            return 1;
+        }
+    }
+    Salida salida{csv, reorden};
+
+    // Crear memoria compartida (con hilos alcanza con memoria anónima del proceso)
+    size_t shmBytes = sizeof(SharedData) + sizeof(Slot) * static_cast<size_t>(K);
+    if (directo) {
+        shmBytes = sizeof(SharedData); // sin anillos: los hijos escriben en el archivo
+    } else if (modoIPC == IPC_SPSC) {
+        shmBytes = sizeof(SharedData) + sizeof(AnilloSPSC) * static_cast<size_t>(N)
+                 + sizeof(Slot) * static_cast<size_t>(K) * static_cast<size_t>(N);
+    }
+    size_t offsetEstad = (shmBytes + 63) & ~static_cast<size_t>(63);
+    shmBytes = offsetEstad + sizeof(EstadGenerador) * static_cast<size_t>(N);
+    if (hilos) {
+        void* m = mmap(nullptr, shmBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED) {
+            perror("mmap");
+            return 1;
+        }
+        shm = static_cast<SharedData*>(m);
+        shmPrivadoBytes = shmBytes;
+    } else {
+        shmid = shmget(SHM_KEY, shmBytes, IPC_CREAT | 0666);
+        if (shmid == -1) {
+            perror("shmget");
+            return 1;
+        }
+
+        shm = (SharedData*)shmat(shmid, nullptr, 0);
+        if (shm == (void*)-1) {
+            perror("shmat");
+            return 1;
+        }
     }
 
     // Inicializar estructura compartida
-    memset(shm, 0, sizeof(SharedData));
-    shm->next_id = 1;
+    memset(static_cast<void*>(shm), 0, shmBytes);
+    shm->next_id.store(1);
     shm->total_registros = total;
     shm->total_escritos = 0;
-    shm->terminar = false;
-    // shm->nuevoRegistro = false; // Ya no se usa
-    shm->id_publicado = 0;
+    shm->terminar.store(false);
     shm->generadoresActivos = N;
+    shm->capacidad = static_cast<unsigned>(K);
+    shm->head.store(0);
+    shm->tail = 0;
+    shm->offsetEstad = offsetEstad;
 
-    // Crear semáforos (SEM_MUTEX, SEM_FULL_SLOT, SEM_EMPTY_SLOT)
-    semid = semget(SEM_KEY, SEM_COUNT, IPC_CREAT | 0666); // Usar SEM_COUNT
-    if (semid == -1) {
-        perror("semget");
-        limpiarRecursos();
-        return 1;
+    // Crear semáforos (SEM_MUTEX, SEM_FULL_SLOT, SEM_EMPTY_SLOT). Solo los usa
+    // el anillo común: SPSC y --directo no necesitan ninguno.
+    bool conSemaforos = modoIPC == IPC_SEMAFOROS && !directo;
+    if (conSemaforos) {
+        semid = semget(SEM_KEY, SEM_COUNT, IPC_CREAT | 0666); // Usar SEM_COUNT
+        if (semid == -1) {
+            perror("semget");
+            limpiarRecursos();
+            return 1;
+        }
     }
 
     // Inicializar semáforos:
     // SEM_MUTEX=1 (libre)
-    // SEM_FULL_SLOT=0 (el slot está vacío inicialmente)
-    // SEM_EMPTY_SLOT=1 (el slot está disponible para un productor)
-    {
+    // SEM_FULL_SLOT=0 (el anillo está vacío inicialmente)
+    // SEM_EMPTY_SLOT=K (los K slots están disponibles para los productores)
+    if (conSemaforos) {
         semun arg;
-        unsigned short init[SEM_COUNT] = {1, 0, 1}; // Correcta inicialización para 3 semáforos
+        unsigned short init[SEM_COUNT] = {1, 0, static_cast<unsigned short>(K)};
         arg.array = init;
         if (semctl(semid, 0, SETALL, arg) == -1) {
             perror("semctl SETALL");
@@ -243,89 +1882,86 @@ static int runCoordinador(int N, int total, const string& rutaCSV) {
     // Manejo de Ctrl+C
     signal(SIGINT, sigint_handler);
 
-    // Lanzar procesos generadores
+    // Lanzar generadores
     vector<pid_t> hijos;
+    vector<thread> hilosGen;
     hijos.reserve(N);
 
-    for (int i = 0; i < N; ++i) {
+    for (int i = 0; i < N && hilos; ++i) {
+        hilosGen.emplace_back(generar, i + 1, N);
+    }
+    for (int i = 0; i < N && !hilos; ++i) {
         pid_t pid = fork();
         if (pid < 0) {
             perror("fork");
-            shm->terminar = true;
+            shm->terminar.store(true);
             // Intentar terminar a los hijos ya lanzados antes de salir
             for (pid_t p : hijos) kill(p, SIGTERM);
             break;
         } else if (pid == 0) {
-            procesoGenerador(i + 1);
+            procesoGenerador(i + 1, N);
         } else {
             hijos.push_back(pid);
         }
     }
 
+    long tArranque = ahoraNs();
+    MonitorVivo monitor(op, csv);
+    monitor.iniciar();
+
     // 🧠 Bucle principal: consumir los registros publicados
-    // Continuar mientras no se hayan escrito todos los registros o queden generadores activos
-    while (true) {
-        // Intentar esperar un registro disponible (slot lleno)
-        // Usamos IPC_NOWAIT para poder revisar la condición de terminación
-        sembuf op_full_wait = {SEM_FULL_SLOT, -1, IPC_NOWAIT};
-        if (semop(semid, &op_full_wait, 1) == -1) {
-            if (errno == EAGAIN) { // No hay elementos disponibles ahora mismo
-                // Revisa condiciones de terminación bajo el mutex
-                sem_wait_idx(semid, SEM_MUTEX);
-                bool all_ids_assigned = (shm->next_id > shm->total_registros);
-                bool all_generators_done = (shm->generadoresActivos == 0);
-                bool all_records_written = (shm->total_escritos >= shm->total_registros);
-                sem_signal_idx(semid, SEM_MUTEX);
-
-                if (all_ids_assigned && all_generators_done && all_records_written) {
-                    // Todos los IDs han sido asignados, todos los generadores han terminado,
-                    // y todos los registros han sido escritos y consumidos.
-                    break; // Salir del bucle
-                }
-                usleep(10000); // Pequeña pausa antes de reintentar si no hay nada disponible
-                continue; // Continuar el bucle para re-chequear las condiciones
-            }
-            perror("semop SEM_FULL_SLOT wait");
-            // Si ocurre un error real en semop, marcar terminar y salir
-            sem_wait_idx(semid, SEM_MUTEX);
-            shm->terminar = true;
-            sem_signal_idx(semid, SEM_MUTEX);
-            break;
+    if (directo) {
+        // El coordinador no está en el camino de los datos: solo espera a los generadores
+        for (pid_t pid : hijos) {
+            int status = 0;
+            waitpid(pid, &status, 0);
         }
+        hijos.clear();
+        for (thread& t : hilosGen) t.join();
+        hilosGen.clear();
+    } else if (modoIPC == IPC_SPSC) {
+        consumirSPSC(salida, N);
+    } else {
+        consumirSemaforos(salida);
+    }
 
-        // Si se llegó aquí, se adquirió SEM_FULL_SLOT, hay un elemento para consumir.
-        // PASO 1: Proteger la lectura del slot compartido con el mutex
-        sem_wait_idx(semid, SEM_MUTEX);
-        string s = shm->registro;
-        // shm->nuevoRegistro ya no se usa
-        shm->total_escritos++;
-        sem_signal_idx(semid, SEM_MUTEX); // Liberar el mutex global
-
-        csv << s << "\n";
-        csv.flush();
+    long tFin = ahoraNs();
+    monitor.detener();
 
-        // PASO 2: Señalar que el slot está ahora vacío, permitiendo a un productor llenarlo.
-        sem_signal_idx(semid, SEM_EMPTY_SLOT);
+    long corridas = 0;
+    bool ordenOk = true;
+    if (reorden) {
+        ordenOk = reorden->finalizar();
+        corridas = reorden->corridas();
+        delete reorden;
     }
 
     // Marcar terminación global para los hijos que aún puedan estar activos
-    // 🔸 Pausa para monitoreo manual de recursos
-    cout << "\n⏸ Programa en pausa para monitoreo.\n";
-    cout << "   Podés abrir otra terminal y ejecutar:\n";
-    cout << "   - ipcs -m   (ver memoria compartida)\n";
-    cout << "   - ipcs -s   (ver semáforos)\n";
-    cout << "   - ps -eLf | grep " << getpid() << "   (ver procesos)\n";
-    cout << "   Cuando termines de observar, presioná ENTER para continuar...\n";
-    cin.get();  // Espera ENTER del usuario
-
-    sem_wait_idx(semid, SEM_MUTEX);
-    shm->terminar = true;
-    sem_signal_idx(semid, SEM_MUTEX);
+    // 🔸 Pausa para monitoreo manual de recursos (salvo en --batch)
+    if (!op.batch) {
+        cout << "\n⏸ Programa en pausa para monitoreo.\n";
+        cout << "   Podés abrir otra terminal y ejecutar:\n";
+        cout << "   - ipcs -m   (ver memoria compartida)\n";
+        cout << "   - ipcs -s   (ver semáforos)\n";
+        cout << "   - ps -eLf | grep " << getpid() << "   (ver procesos)\n";
+        cout << "   Cuando termines de observar, presioná ENTER para continuar...\n";
+        cin.get();  // Espera ENTER del usuario
+    }
+
+    shm->terminar.store(true);
 
     // Despertar a TODOS los generadores que puedan estar bloqueados en SEM_EMPTY_SLOT
     // para que puedan ver la bandera `terminar` y salir limpiamente.
-    for (int i = 0; i < N; ++i) {
-        sem_signal_idx(semid, SEM_EMPTY_SLOT);
+    // Cada productor puede estar pidiendo hasta K slots (sin pasar el máximo de semop).
+    if (conSemaforos) {
+        for (int i = 0; i < N; ++i) {
+            int libres = semctl(semid, SEM_EMPTY_SLOT, GETVAL);
+            int sumar = std::min<int>(shm->capacidad, 32767 - libres);
+            if (sumar > 0) sem_op_n(semid, SEM_EMPTY_SLOT, sumar);
+        }
+    }
+    if (modoIPC == IPC_SPSC && !directo) {
+        for (int i = 0; i < N; ++i) futex_wake(&anillosDe(shm)[i].tail);
     }
 
     // Esperar a todos los hijos
@@ -333,20 +1969,51 @@ static int runCoordinador(int N, int total, const string& rutaCSV) {
         int status = 0;
         waitpid(pid, &status, 0);
     }
+    for (thread& t : hilosGen) t.join();
 
-    csv.flush();
-    csv.close();
+    bool escrituraOk = csv.cerrar() && ordenOk;
+    if (op.binario) {
+        escrituraOk = binaria.cerrar() && escrituraOk;
+        salidaBinaria = nullptr;
+    } else if (directo) {
+        escrituraOk = directa.cerrar() && escrituraOk;
+        salidaDirecta = nullptr;
+        if (int largas = shm->filasLargas.load()) {
+            cerr << "ERROR: " << largas << " filas superaron el ancho fijo de " << anchoFilaMaximo(N, total) << " bytes\n";
+            escrituraOk = false;
+        }
+    }
 
     // 🔹 Pequeña pausa para asegurar cierre completo antes de la limpieza
-    usleep(200000); // 0.2 seg
+    if (!op.batch) usleep(200000); // 0.2 seg
+
+    uint64_t bytes = op.binario ? binaria.bytes() : directo ? directa.bytes() : csv.bytesEscritos();
+    bool metricasOk = reportarMetricas(op, tFin - tInicio, tArranque - tInicio, bytes);
 
     // Limpieza final de recursos IPC
     limpiarRecursos(false);
 
+    if (!metricasOk) {
+        cerr << "ERROR: No se pudieron escribir las métricas en " << op.rutaJSON << "\n";
+        return 1;
+    }
+
+    if (!escrituraOk) {
+        cerr << "ERROR: Falló la escritura de " << rutaCSV << "\n";
+        return 1;
+    }
+
     // 🟢 Resumen final
     cout << "\n✅ Archivo generado con éxito: " << rutaCSV
          << "\n📄 Registros totales: " << total // Usar 'total' que es el valor esperado
-         << "\n👥 Generadores usados: " << N
+         << "\n👥 Generadores usados: " << N << (hilos ? " (hilos)" : " (procesos)")
+         << "\n⏱  Arranque: " << (tArranque - tInicio) / 1000 << " us, generación: "
+         << (tFin - tInicio) / 1000000 << " ms ("
+         << static_cast<long>(total * 1e9 / std::max(1L, tFin - tInicio)) << " registros/s)"
+         << "\n💾 Bytes escritos: " << bytes
+         << (op.binario ? "\n🧱 Snapshot binario columnar (formato v" + to_string(SNAP_VERSION) + ")"
+             : directo ? "\n🗺  Escritura directa en el archivo mapeado (filas de ancho fijo)" : "")
+         << (ventanaOrden > 0 && !directo ? "\n🔢 Salida ordenada por ID (corridas a disco: " + to_string(corridas) + ")" : "")
          << "\n----------------------------------------\n";
 
     return 0;
@@ -354,21 +2021,121 @@ static int runCoordinador(int N, int total, const string& rutaCSV) {
 
 // ---------------------------------- main -------------------------------------
 static void print_help(const char* prog) {
-    cerr << "Uso: " << prog << " <N_generadores> <total_registros> <salida.csv>\n"
-         << "Ej.: " << prog << " 4 200 datos.csv\n";
+    cerr << "Uso: " << prog << " <N_generadores> <total_registros> <salida.csv> [opciones]\n"
+         << "   --slots K   capacidad del anillo en memoria compartida (por defecto " << SLOTS_DEFAULT << ")\n"
+         << "   --ipc sem   un anillo común sincronizado con semáforos SysV (por defecto)\n"
+         << "   --ipc spsc  un anillo por generador con atómicos y futex; K slots cada uno\n"
+         << "   --flush-cada N   volcar el CSV cada N registros\n"
+         << "   --flush-ms T     volcar el CSV cada T milisegundos\n"
+         << "   --fdatasync      fdatasync después de cada volcado (sin él no se sincroniza con el disco)\n"
+         << "   (sin --flush-*: se vuelca solo al llenar los buffers y al final)\n"
+         << "   --ordenado       emitir las filas estrictamente por ID\n"
+         << "   --ventana W      registros que el reordenamiento guarda en memoria (por defecto " << VENTANA_DEFAULT << ")\n"
+         << "   --semilla S      PRNG reproducible: misma semilla, mismos datos por ID\n"
+         << "                    (junto con --ordenado o --directo, archivo idéntico byte a byte)\n"
+         << "   --motor procesos fork + memoria compartida SysV (por defecto)\n"
+         << "   --motor hilos    generadores como std::thread en un solo proceso (alias: --threads)\n"
+         << "   --batch          sin pausa al final; métricas en vivo cada segundo por stderr\n"
+         << "   --metricas-ms T  intervalo de las métricas en vivo (0 = no mostrarlas)\n"
+         << "   --metricas-json F  guardar las métricas finales en F (JSON)\n"
+         << "   --esquema F      columnas, pools y distribuciones desde el archivo F (ver esquema.txt)\n"
+         << "   --formato binario  snapshot columnar (ID/enteros fijos, textos con diccionario) que\n"
+         << "                    el servidor carga con mmap; se escribe como --directo\n"
+         << "   --directo        cada generador escribe sus filas en el archivo mapeado (mmap);\n"
+         << "                    filas de ancho fijo rellenas con líneas vacías, ordenadas por ID\n"
+         << "Ej.: " << prog << " 4 200 datos.csv --slots 512\n";
 }
 
 int main(int argc, char* argv[]) {
     ios::sync_with_stdio(false);
 
-    if (argc != 4) {
+    if (argc < 4) {
         print_help(argv[0]);
         return 1;
     }
 
-    int N = atoi(argv[1]);
-    int total = atoi(argv[2]);
-    string rutaCSV = argv[3];
+    Opciones op;
+    op.N = atoi(argv[1]);
+    op.total = atoi(argv[2]);
+    op.rutaCSV = argv[3];
+    bool ordenado = false;
+    int ventana = VENTANA_DEFAULT;
+    long metricasMs = -1; // -1 = según --batch
+    string rutaEsquema;
+
+    for (int i = 4; i < argc; ++i) {
+        string opt = argv[i];
+        if (opt == "--slots" && i + 1 < argc) {
+            op.K = atoi(argv[++i]);
+        } else if (opt == "--flush-cada" && i + 1 < argc) {
+            op.politica.cadaRegistros = atol(argv[++i]);
+        } else if (opt == "--flush-ms" && i + 1 < argc) {
+            op.politica.cadaMs = atol(argv[++i]);
+        } else if (opt == "--fdatasync") {
+            op.politica.fdatasync = true;
+        } else if (opt == "--ordenado") {
+            ordenado = true;
+        } else if (opt == "--ventana" && i + 1 < argc) {
+            ventana = atoi(argv[++i]);
+        } else if (opt == "--directo") {
+            op.directo = true;
+        } else if (opt == "--formato" && i + 1 < argc) {
+            string formato = argv[++i];
+            if (formato == "csv") {
+                op.binario = false;
+            } else if (formato == "binario") {
+                op.binario = true;
+            } else {
+                cerr << "ERROR: --formato debe ser 'csv' o 'binario'.\n";
+                return 1;
+            }
+        } else if (opt == "--semilla" && i + 1 < argc) {
+            semillaFija = true;
+            semillaUsuario = strtoull(argv[++i], nullptr, 10);
+        } else if (opt == "--esquema" && i + 1 < argc) {
+            rutaEsquema = argv[++i];
+        } else if (opt == "--batch") {
+            op.batch = true;
+        } else if (opt == "--metricas-ms" && i + 1 < argc) {
+            metricasMs = atol(argv[++i]);
+        } else if (opt == "--metricas-json" && i + 1 < argc) {
+            op.rutaJSON = argv[++i];
+        } else if (opt == "--threads") {
+            op.motor = MOTOR_HILOS;
+        } else if (opt == "--motor" && i + 1 < argc) {
+            string motor = argv[++i];
+            if (motor == "procesos") {
+                op.motor = MOTOR_PROCESOS;
+            } else if (motor == "hilos") {
+                op.motor = MOTOR_HILOS;
+            } else {
+                cerr << "ERROR: --motor debe ser 'procesos' o 'hilos'.\n";
+                return 1;
+            }
+        } else if (opt == "--ipc" && i + 1 < argc) {
+            string modo = argv[++i];
+            if (modo == "sem") {
+                modoIPC = IPC_SEMAFOROS;
+            } else if (modo == "spsc") {
+                modoIPC = IPC_SPSC;
+            } else {
+                cerr << "ERROR: --ipc debe ser 'sem' o 'spsc'.\n";
+                return 1;
+            }
+        } else {
+            cerr << "ERROR: opción desconocida o incompleta: " << opt << "\n";
+            print_help(argv[0]);
+            return 1;
+        }
+    }
+    const int N = op.N, total = op.total;
+    const string& rutaCSV = op.rutaCSV;
+
+    // SEM_EMPTY_SLOT arranca en K y semop suma de a short: acotar K
+    if (op.K <= 0 || op.K > 32767) {
+        cerr << "ERROR: --slots debe estar entre 1 y 32767.\n";
+        return 1;
+    }
 
     if (N <= 0 || total <= 0) {
         cerr << "ERROR: N_generadores y total_registros deben ser enteros positivos.\n";
@@ -381,7 +2148,37 @@ int main(int argc, char* argv[]) {
         cerr << "ADVERTENCIA: el nombre de archivo parece no tener extensión. Se recomienda .csv\n";
     }
 
-    int rc = runCoordinador(N, total, rutaCSV);
+    if (op.politica.cadaRegistros < 0 || op.politica.cadaMs < 0) {
+        cerr << "ERROR: --flush-cada y --flush-ms no pueden ser negativos.\n";
+        return 1;
+    }
+
+    if (ventana <= 0) {
+        cerr << "ERROR: --ventana debe ser un entero positivo.\n";
+        return 1;
+    }
+
+    op.ventanaOrden = ordenado ? ventana : 0;
+    if (op.binario) op.directo = true; // el snapshot siempre se escribe en su lugar por ID
+
+    if (rutaEsquema.empty()) {
+        esquema.porDefecto();
+    } else {
+        string error;
+        if (!esquema.cargar(rutaEsquema, error)) {
+            cerr << "ERROR: esquema: " << error << "\n";
+            return 1;
+        }
+    }
+    // Cada fila se arma en un slot de REG_MAX bytes (con el '\n' de --directo)
+    if (anchoFilaMaximo(N, total) > REG_MAX) {
+        cerr << "ERROR: las filas del esquema pueden ocupar " << anchoFilaMaximo(N, total)
+             << " bytes; el máximo es " << REG_MAX << ".\n";
+        return 1;
+    }
+    op.metricasMs = metricasMs >= 0 ? metricasMs : (op.batch ? 1000 : 0);
+
+    int rc = runCoordinador(op);
     if (rc == 0) {
         cout << "OK: Generados " << total << " registros en '" << rutaCSV << "'.\n";
         cout << "Sugerencia de monitoreo: ipcs -m/-s, ps -eLf, htop, vmstat.\n";
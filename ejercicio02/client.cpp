@@ -14,6 +14,47 @@
 #include <cerrno>        // Para errno
 #include <vector>        // Para usar std::vector (no estrictamente necesario aquí, pero buena práctica)
 
+// Comandos enviados sin esperar respuesta cuando la entrada no es una terminal
+const size_t PIPELINE_DEPTH = 256;
+
+// Lee una respuesta completa del servidor: bloques "<largo>\n<datos>" hasta el
+// bloque vacío "0\n", que se escriben en `out` a medida que llegan (un QUERY
+// grande llega en muchos bloques), precedidos por "Server response:". Una
+// respuesta vacía (las filas de un BULK_ADD) no imprime nada. `pending` guarda
+// los bytes leídos de más (el comienzo de la respuesta siguiente). Devuelve
+// false si el servidor se desconecta.
+bool read_response(int sock, std::string& pending, std::ostream& out) {
+    size_t pos = 0;
+    bool printed = false;
+    char buffer[65536];
+    while (true) {
+        size_t nl = pending.find('\n', pos);
+        if (nl != std::string::npos) {
+            size_t len = std::stoul(pending.substr(pos, nl - pos));
+            if (len == 0) {
+                pending.erase(0, nl + 1);
+                return true;
+            }
+            if (pending.size() - (nl + 1) >= len) {
+                if (!printed) {
+                    out << "Server response:\n";
+                    printed = true;
+                }
+                out.write(pending.data() + nl + 1, len);
+                pos = nl + 1 + len;
+                continue;
+            }
+        }
+        pending.erase(0, pos); // Lo ya consumido
+        pos = 0;
+        ssize_t n = read(sock, buffer, sizeof(buffer));
+        if (n <= 0) {
+            return false;
+        }
+        pending.append(buffer, n);
+    }
+}
+
 // Función para verificar si un mensaje del servidor indica que está "listo" para comandos
 bool is_server_ready_message(const std::string& msg) {
     return msg.find("Connected and ready to process commands") != std::string::npos ||
@@ -107,14 +148,62 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    // Con la entrada redirigida (./client ip puerto < comandos.txt) los comandos
+    // van en lote: se envían hasta PIPELINE_DEPTH seguidos y después se leen
+    // sus respuestas, que el servidor devuelve en el mismo orden.
+    bool interactive = isatty(STDIN_FILENO);
+    std::string pending;
+    if (!interactive) {
+        std::string command_line, batch;
+        size_t in_flight = 0;
+        bool more = true, ok = true;
+        while (more && ok) {
+            more = static_cast<bool>(std::getline(std::cin, command_line));
+            if (more && command_line == "EXIT") {
+                more = false;
+            }
+            if (more && !command_line.empty()) {
+                batch += command_line + "\n";
+                in_flight++;
+            }
+            if (in_flight == 0 || (more && in_flight < PIPELINE_DEPTH)) {
+                continue;
+            }
+            if (send(sock, batch.data(), batch.size(), 0) != static_cast<ssize_t>(batch.size())) {
+                std::cerr << "Error sending data: " << strerror(errno) << "\n";
+                break;
+            }
+            batch.clear();
+            for (; in_flight > 0; in_flight--) {
+                if (!read_response(sock, pending, std::cout)) {
+                    std::cerr << "Server disconnected.\n";
+                    ok = false;
+                    break;
+                }
+            }
+        }
+        close(sock);
+        return ok ? 0 : 1;
+    }
+
     std::cout << "Available commands:\n";
     std::cout << "  QUERY <term>           (e.g., QUERY Ana, QUERY Cordoba)\n";
-    std::cout << "  BEGIN_TRANSACTION      (Starts an exclusive transaction)\n";
-    std::cout << "  COMMIT_TRANSACTION     (Ends the active transaction)\n";
+    std::cout << "  QUERY <Col>=<val> [AND <Col>=<val> ...] (e.g., QUERY Nombre=Ana AND Ciudad=Cordoba)\n";
+    std::cout << "  QUERY ... LIMIT <n> OFFSET <m> (e.g., QUERY Cordoba LIMIT 100 OFFSET 200, one page of the results)\n";
+    std::cout << "  OPEN_CURSOR <query>    (e.g., OPEN_CURSOR Cordoba, reads a snapshot of the results page by page)\n";
+    std::cout << "  FETCH <cursor> <n>     (e.g., FETCH 1 100, the next 100 rows of cursor 1)\n";
+    std::cout << "  CLOSE_CURSOR <cursor>  (e.g., CLOSE_CURSOR 1)\n";
+    std::cout << "  GET <ID>               (e.g., GET 1, fetches one record by ID)\n";
+    std::cout << "  BEGIN_TRANSACTION      (Starts a transaction; its changes stay private until COMMIT)\n";
+    std::cout << "  COMMIT_TRANSACTION     (Applies the transaction's changes atomically)\n";
+    std::cout << "  ROLLBACK_TRANSACTION   (Discards the transaction's changes)\n";
     std::cout << "  ADD <ID>,<Nombre>,<Edad>,<Ciudad>,<Fuente> (e.g., ADD 5,Pedro,35,Mendoza,Gen3)\n";
     std::cout << "  MODIFY <ID> <ID>,<Nombre>,<Edad>,<Ciudad>,<Fuente> (e.g., MODIFY 1 1,Ana,26,Buenos Aires,Gen1_new)\n";
     std::cout << "  DELETE <ID>            (e.g., DELETE 2)\n";
+    std::cout << "  LOAD <path>            (e.g., LOAD /data/datos.csv, adds a CSV file on the server in one transaction)\n";
+    std::cout << "  BULK_ADD               (Then one record per line and END_BULK; adds them all in one transaction)\n";
     std::cout << "  EXIT                   (Disconnects from server)\n";
+    std::cout << "(Redirect a file to stdin to send its commands pipelined: ./client <ip> <port> < commands.txt)\n";
     std::cout << "--------------------------------------------------------------------------------\n";
 
 
@@ -132,24 +221,18 @@ int main(int argc, char* argv[]) {
             continue;
         }
 
-        // Send the command to the server
+        // Send the command to the server, one line per command
+        command_line += "\n";
         if (send(sock, command_line.c_str(), command_line.length(), 0) == -1) {
             std::cerr << "Error sending data: " << strerror(errno) << "\n";
             break;
         }
 
-        // Read response from server
-        memset(buffer, 0, sizeof(buffer)); // Clear buffer before reading
-        int valread = read(sock, buffer, sizeof(buffer) - 1);
-        if (valread == 0) {
+        // Read the whole response, however many reads it takes
+        if (!read_response(sock, pending, std::cout)) {
             std::cerr << "Server disconnected.\n";
             break;
-        } else if (valread == -1) {
-            std::cerr << "Error reading from server: " << strerror(errno) << "\n";
-            break;
         }
-        buffer[valread] = '\0'; // Asegurar terminación nula
-        std::cout << "Server response:\n" << buffer;
     }
 
     close(sock);
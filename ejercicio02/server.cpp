@@ -1,6 +1,6 @@
 // server.cpp
 // Ejercicio 2 - Cliente-Servidor de Micro Base de Datos con Transacciones
-// Compilar: g++ -std=gnu++17 server.cpp -o server
+// Compilar: g++ -std=gnu++17 -pthread server.cpp -o server
 // Ejecutar: ./server <puerto> <ruta_csv> <N_clientes_concurrentes> <M_clientes_en_espera_app_queue>
 
 #include <iostream>
@@ -13,29 +13,319 @@
 
 #include <sys/socket.h>
 #include <netinet/in.h>
-#include <unistd.h>    // For close, fork, read, write, usleep
+#include <netinet/tcp.h> // For TCP_NODELAY
+#include <unistd.h>    // For close, read, write
 #include <arpa/inet.h> // For inet_ntoa
-#include <sys/file.h>  // For flock
 #include <cstring>     // For memset, strerror
 #include <csignal>     // For sigaction
-#include <sys/wait.h>  // For waitpid
 #include <fcntl.h>     // For open, fcntl, O_NONBLOCK
 #include <queue>       // For std::queue
+#include <sys/mman.h>  // For mmap (binary snapshots)
+#include <sys/stat.h>  // For fstat
+#include <charconv>    // For std::to_chars
+#include <cstdint>
+#include <limits>
+#include <thread>        // One handler thread per client
+#include <shared_mutex>  // Index latch
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <new>       // Placement new into reserved memory
+#include <stdexcept>
+#include <unordered_map>
+#include <string_view>
+#include <condition_variable>
+#include <sys/epoll.h>   // epoll mode reactor
+#include <poll.h>        // Thread mode acceptors
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>   // SSE2/AVX2 substring scan
+#endif
 
 // --- Global CSV file path ---
 static std::string g_csv_path;
 
-// --- Global counter for active child processes and limits ---
-static int active_child_processes = 0;
-static int max_allowed_concurrent_clients = 0; // N: Clientes atendidos por hijos
+// --- Global counter for active client handlers and limits ---
+static std::atomic<int> active_client_handlers{0};
+static std::atomic<int> next_handler_id{0};
+static int max_allowed_concurrent_clients = 0; // N: Clientes atendidos por hilos manejadores
 static int max_app_waiting_clients_queue = 0;  // M: Clientes en cola de espera de la aplicación
 
-// --- Cola de clientes aceptados pero en espera de un manejador hijo ---
+// --- Cola de clientes aceptados pero en espera de un hilo manejador ---
 static std::queue<int> waiting_client_sockets; // FDs de clientes en espera
 
+// --- Binary columnar snapshot ---
+// Written by ejercicio01/app.cpp with --formato binario. The layout must match
+// CabeceraSnap/ColumnaSnap there: header, column descriptors, dictionaries and
+// one fixed-width array per column, indexed by ID-1 (native little-endian).
+static const char SNAP_MAGIC[8] = {'T', 'P', 'S', 'N', 'A', 'P', '\r', '\n'};
+#define SNAP_VERSION 1
+enum SnapType : uint32_t
+{
+    SNAP_INT32 = 1,
+    SNAP_INT64 = 2,
+    SNAP_DICT = 3, // uint32 code into the column dictionary
+    SNAP_TEXT = 4  // fixed-width text padded with '\0'
+};
+
+struct SnapHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t columns;
+    uint64_t rows;
+    uint64_t bytes;
+    uint64_t columns_offset;
+    char reserved[24];
+};
+
+struct SnapColumn
+{
+    char name[32];
+    uint32_t type;
+    uint32_t width;
+    uint64_t data_offset;
+    uint64_t dict_offset; // uint32 end[dict_size] followed by the concatenated texts
+    uint32_t dict_size;
+    uint32_t reserved;
+};
+static_assert(sizeof(SnapHeader) == 64 && sizeof(SnapColumn) == 64, "snapshot layout");
+
+// A whole file mapped read-only, for reading it in place
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile()
+    {
+        if (size_ > 0)
+            munmap(const_cast<char *>(data_), size_);
+    }
+
+    // Returns false with errno set if the file cannot be opened or mapped
+    bool open(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+            return false;
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0;
+        if (ok && st.st_size > 0)
+        {
+            void *map = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = map != MAP_FAILED;
+            if (ok)
+            {
+                data_ = static_cast<const char *>(map);
+                size_ = static_cast<size_t>(st.st_size);
+                madvise(map, size_, MADV_SEQUENTIAL);
+            }
+        }
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return ok;
+    }
+
+    std::string_view text() const { return std::string_view(data_, size_); }
+
+private:
+    const char *data_ = "";
+    size_t size_ = 0;
+};
+
+// A mapped snapshot, checked once when opened. Rows are formatted one at a
+// time from the column arrays and dictionaries, so loading one never holds
+// its text as a whole, and the ID and dictionary codes are read directly.
+class Snapshot
+{
+public:
+    enum Status
+    {
+        NOT_SNAPSHOT, // plain CSV: the caller reads it as text
+        OK,
+        BAD // a snapshot that cannot be mapped, truncated or inconsistent
+    };
+
+    Snapshot() = default;
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+
+    Status open(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+            return NOT_SNAPSHOT;
+        char magic[sizeof(SNAP_MAGIC)];
+        struct stat st;
+        if (pread(fd, magic, sizeof(magic), 0) != static_cast<ssize_t>(sizeof(magic)) ||
+            memcmp(magic, SNAP_MAGIC, sizeof(magic)) != 0 || fstat(fd, &st) == -1)
+        {
+            close(fd);
+            return NOT_SNAPSHOT;
+        }
+        close(fd);
+        if (!file_.open(path))
+        {
+            perror(("mmap " + path).c_str());
+            return BAD;
+        }
+        map_ = file_.text().data();
+        size_ = file_.text().size();
+        if (!decode())
+        {
+            std::cerr << "Error: Corrupt or unsupported binary snapshot: " << path << std::endl;
+            return BAD;
+        }
+        return OK;
+    }
+
+    const std::string &header() const { return header_; }
+    uint64_t rows() const { return rows_; }
+
+    // Text of cell (row, c): into the map, the dictionary or `number`
+    std::string_view cell(uint64_t row, size_t c, char (&number)[24]) const
+    {
+        const SnapColumn &col = columns_[c];
+        const char *cell = map_ + col.data_offset + row * col.width;
+        if (col.type == SNAP_INT32 || col.type == SNAP_INT64)
+        {
+            int64_t value = integer(col, cell);
+            return std::string_view(number, std::to_chars(number, number + sizeof(number), value).ptr - number);
+        }
+        if (col.type == SNAP_DICT)
+        {
+            uint32_t code;
+            memcpy(&code, cell, sizeof(code));
+            return dicts_[c][code];
+        }
+        return std::string_view(cell, strnlen(cell, col.width));
+    }
+
+    // The row as a CSV line, built in `line`
+    std::string_view row(uint64_t row, std::string &line) const
+    {
+        char number[24];
+        line.clear();
+        for (size_t c = 0; c < columns_.size(); ++c)
+        {
+            if (c > 0)
+                line += ',';
+            line += cell(row, c, number);
+        }
+        return line;
+    }
+
+    // The row's ID, as row_id() would parse it from the line
+    bool id(uint64_t row, int &id) const
+    {
+        const SnapColumn &col = columns_[0];
+        const char *cell = map_ + col.data_offset + row * col.width;
+        if (col.type == SNAP_INT32 || col.type == SNAP_INT64)
+        {
+            int64_t value = integer(col, cell);
+            id = static_cast<int>(value);
+            return value >= std::numeric_limits<int>::min() && value <= std::numeric_limits<int>::max();
+        }
+        char number[24];
+        std::string_view text = this->cell(row, 0, number);
+        auto res = std::from_chars(text.data(), text.data() + text.size(), id);
+        return res.ec == std::errc() && (res.ptr == text.data() + text.size() || *res.ptr == ',');
+    }
+
+    // Dictionary of column c, empty unless it is a SNAP_DICT one
+    const std::vector<std::string_view> &dictionary(size_t c) const { return dicts_[c]; }
+
+    // Code of cell (row, c) in dictionary(c). Column c must be a SNAP_DICT one.
+    uint32_t code(uint64_t row, size_t c) const
+    {
+        uint32_t code;
+        memcpy(&code, map_ + columns_[c].data_offset + row * columns_[c].width, sizeof(code));
+        return code;
+    }
+
+private:
+    static int64_t integer(const SnapColumn &col, const char *cell)
+    {
+        if (col.type == SNAP_INT32)
+        {
+            int32_t v32;
+            memcpy(&v32, cell, sizeof(v32));
+            return v32;
+        }
+        int64_t value;
+        memcpy(&value, cell, sizeof(value));
+        return value;
+    }
+
+    // Checks every offset and dictionary code once, so formatting rows needs
+    // no checks. Returns false if the file is truncated or inconsistent.
+    bool decode()
+    {
+        SnapHeader header;
+        if (size_ < sizeof(header))
+            return false;
+        memcpy(&header, map_, sizeof(header));
+        if (header.version != SNAP_VERSION || header.bytes != size_ || header.columns == 0 ||
+            header.columns_offset > size_ || header.columns * sizeof(SnapColumn) > size_ - header.columns_offset)
+            return false;
+        rows_ = header.rows;
+        columns_.resize(header.columns);
+        memcpy(columns_.data(), map_ + header.columns_offset, header.columns * sizeof(SnapColumn));
+
+        dicts_.resize(columns_.size());
+        for (size_t c = 0; c < columns_.size(); ++c)
+        {
+            const SnapColumn &col = columns_[c];
+            bool width_ok = (col.type == SNAP_INT32 && col.width == 4) || (col.type == SNAP_INT64 && col.width == 8) ||
+                            (col.type == SNAP_DICT && col.width == 4) || (col.type == SNAP_TEXT && col.width > 0);
+            if (!width_ok || col.data_offset > size_ || rows_ > (size_ - col.data_offset) / col.width)
+                return false;
+            if (col.type == SNAP_DICT)
+            {
+                if (col.dict_offset > size_ || col.dict_size > (size_ - col.dict_offset) / sizeof(uint32_t))
+                    return false;
+                const char *ends = map_ + col.dict_offset;
+                const char *text = ends + col.dict_size * sizeof(uint32_t);
+                uint32_t begin = 0;
+                for (uint32_t v = 0; v < col.dict_size; ++v)
+                {
+                    uint32_t end;
+                    memcpy(&end, ends + v * sizeof(uint32_t), sizeof(end));
+                    if (end < begin || static_cast<size_t>(text - map_) + end > size_)
+                        return false;
+                    dicts_[c].emplace_back(text + begin, end - begin);
+                    begin = end;
+                }
+                for (uint64_t row = 0; row < rows_; ++row)
+                {
+                    if (code(row, c) >= col.dict_size)
+                        return false;
+                }
+            }
+            if (c > 0)
+                header_ += ',';
+            header_.append(col.name, strnlen(col.name, sizeof(col.name)));
+        }
+        return true;
+    }
+
+    MappedFile file_;
+    const char *map_ = nullptr; // file_'s text
+    size_t size_ = 0;
+    uint64_t rows_ = 0;
+    std::vector<SnapColumn> columns_;
+    std::vector<std::vector<std::string_view>> dicts_; // Into the map
+    std::string header_;
+};
+
 // --- Helper Functions for CSV operations ---
 
-// Reads all lines from the CSV file
+// Reads all lines from the CSV file, skipping empty ones (the generator's
+// --directo output pads its fixed-width rows with them)
 std::vector<std::string> read_csv_data(const std::string &path)
 {
     std::vector<std::string> data;
@@ -45,7 +335,8 @@ std::vector<std::string> read_csv_data(const std::string &path)
         std::string line;
         while (std::getline(file, line))
         {
-            data.push_back(line);
+            if (!line.empty())
+                data.push_back(line);
         }
         file.close();
     }
@@ -56,338 +347,3685 @@ std::vector<std::string> read_csv_data(const std::string &path)
     return data;
 }
 
-// Writes all data back to the CSV file (overwrites existing content)
-bool write_csv_data(const std::string &path, const std::vector<std::string> &data)
+// --- Row storage ---
+// Rows are multi-versioned, so readers never wait for writers. A write never
+// touches the row it replaces: it appends a new version to the slot's chain
+// (newest first), with the row bytes, ending in '\n', at the end of a large
+// mmap'ed chunk. A version's `begin` is the commit timestamp that published
+// it, or PENDING|owner while its transaction is open; a reader at snapshot ts
+// sees, per slot, the newest version with begin <= ts (plus its own pending
+// ones). Chunks, versions and slot heads sit in address ranges reserved up
+// front, and each counter is published after the entries it covers, so a
+// reader can walk them while a writer appends. A full-text QUERY is one pass
+// over the chunks; each chunk records which slot owns each row start, so a
+// hit maps back to its slot by binary search and is kept if that row start is
+// the version the reader sees. Superseded versions are dropped by copying the
+// rest into a new RowStore, off the writers' path (see compact_table).
+
+// Substring search kernel: compares the first and last bytes of the needle at
+// 32 (AVX2) or 16 (SSE2) positions at once and memcmp's only the candidates.
+// The instruction set is picked at runtime; other targets use memmem.
+static const char *find_scalar(const char *s, const char *end, std::string_view needle)
 {
-    std::ofstream file(path, std::ios::out | std::ios::trunc);
-    if (file.is_open())
+    return static_cast<const char *>(memmem(s, end - s, needle.data(), needle.size()));
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static const char *find_avx2(const char *s, const char *end, std::string_view needle)
+{
+    const size_t n = needle.size();
+    const __m256i first = _mm256_set1_epi8(needle.front());
+    const __m256i last = _mm256_set1_epi8(needle.back());
+    for (; end - s >= static_cast<ptrdiff_t>(n + 31); s += 32)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + n - 1));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        for (; mask != 0; mask &= mask - 1)
+        {
+            const char *candidate = s + __builtin_ctz(mask);
+            if (memcmp(candidate, needle.data(), n) == 0)
+                return candidate;
+        }
+    }
+    return find_scalar(s, end, needle);
+}
+
+static const char *find_sse2(const char *s, const char *end, std::string_view needle)
+{
+    const size_t n = needle.size();
+    const __m128i first = _mm_set1_epi8(needle.front());
+    const __m128i last = _mm_set1_epi8(needle.back());
+    for (; end - s >= static_cast<ptrdiff_t>(n + 15); s += 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + n - 1));
+        uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        for (; mask != 0; mask &= mask - 1)
+        {
+            const char *candidate = s + __builtin_ctz(mask);
+            if (memcmp(candidate, needle.data(), n) == 0)
+                return candidate;
+        }
+    }
+    return find_scalar(s, end, needle);
+}
+#endif
+
+using FindFn = const char *(*)(const char *, const char *, std::string_view);
+
+static FindFn pick_find()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return find_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return find_sse2;
+#endif
+    return find_scalar;
+}
+
+static const FindFn find_substring = pick_find();
+
+class RowStore
+{
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+    static constexpr uint64_t PENDING = uint64_t(1) << 63;
+    static constexpr uint64_t LATEST = UINT64_MAX; // ts/owner that sees every version, pending or not
+
+    RowStore()
+        : versions_(reserve<Version>(MAX_VERSIONS)), heads_(reserve<std::atomic<uint32_t>>(MAX_SLOTS)),
+          chunks_(new Chunk[MAX_CHUNKS])
+    {
+    }
+    RowStore(const RowStore &) = delete;
+    RowStore &operator=(const RowStore &) = delete;
+
+    ~RowStore()
+    {
+        munmap(versions_, MAX_VERSIONS * sizeof(Version));
+        munmap(heads_, MAX_SLOTS * sizeof(std::atomic<uint32_t>));
+        for (uint32_t i = 0; i < chunk_count_.load(); ++i)
+        {
+            munmap(chunks_[i].base, chunks_[i].capacity);
+            munmap(chunks_[i].owners, chunks_[i].owner_capacity * sizeof(Owner));
+        }
+    }
+
+    uint32_t slots() const { return slot_count_.load(std::memory_order_acquire); }
+    // Writer side: rows in the latest state, and versions stored
+    size_t size() const { return live_; }
+    size_t versions() const { return version_count_.load(std::memory_order_relaxed); }
+
+    // Version of `slot` that a reader at snapshot `ts` sees, or NONE if the row
+    // does not exist for it. `owner` also sees its own pending versions.
+    uint32_t visible(uint32_t slot, uint64_t ts, uint64_t owner = 0) const
+    {
+        for (uint32_t v = heads_[slot].load(std::memory_order_acquire); v != NONE; v = versions_[v].older)
+        {
+            uint64_t begin = versions_[v].begin.load(std::memory_order_acquire);
+            bool seen = (begin & PENDING) ? owner == LATEST || begin == (PENDING | owner) : begin <= ts;
+            if (seen)
+                return versions_[v].len == TOMBSTONE ? NONE : v;
+        }
+        return NONE;
+    }
+
+    // Writer side: whether the newest version of `slot` is still pending
+    bool pending(uint32_t slot) const
+    {
+        return newest(slot) & PENDING;
+    }
+
+    // Writer side: begin of the newest version of `slot`, deletions included
+    // (a commit timestamp or PENDING|owner), or 0 if it has none
+    uint64_t newest(uint32_t slot) const
+    {
+        uint32_t v = heads_[slot].load(std::memory_order_relaxed);
+        return v == NONE ? 0 : versions_[v].begin.load(std::memory_order_relaxed);
+    }
+
+    std::string_view text(uint32_t v) const
+    {
+        const Version &ver = versions_[v];
+        return std::string_view(chunks_[ver.chunk].base + ver.offset, ver.len);
+    }
+
+    // Writer side (one at a time): a new slot with no versions
+    uint32_t add_slot()
+    {
+        uint32_t slot = slot_count_.load(std::memory_order_relaxed);
+        if (slot == MAX_SLOTS)
+            throw std::length_error("RowStore: too many rows");
+        heads_[slot].store(NONE, std::memory_order_relaxed);
+        slot_count_.store(slot + 1, std::memory_order_release);
+        return slot;
+    }
+
+    // Writer side: a new version of `slot` holding `line`, or a deletion
+    void write(uint32_t slot, std::string_view line, uint64_t begin)
+    {
+        touch(slot);
+        live_ += visible(slot, LATEST, LATEST) == NONE;
+        push(slot, &line, begin);
+    }
+
+    void remove(uint32_t slot, uint64_t begin)
+    {
+        touch(slot);
+        live_ -= visible(slot, LATEST, LATEST) != NONE;
+        push(slot, nullptr, begin);
+    }
+
+    // Writer side: stamps `owner`'s pending versions of `slot` with commit
+    // timestamp ts. Readers see them once the table's commit_ts reaches ts.
+    void publish(uint32_t slot, uint64_t owner, uint64_t ts)
+    {
+        touch(slot);
+        for (uint32_t v = heads_[slot].load(std::memory_order_relaxed); v != NONE; v = versions_[v].older)
+        {
+            if (versions_[v].begin.load(std::memory_order_relaxed) != (PENDING | owner))
+                break;
+            versions_[v].begin.store(ts, std::memory_order_release);
+        }
+    }
+
+    // Writer side: drops `owner`'s pending versions of `slot`, as if they
+    // were never written. Readers skip them anyway, so unlinking is enough;
+    // the next compaction leaves them behind.
+    void discard(uint32_t slot, uint64_t owner)
+    {
+        touch(slot);
+        bool was_live = visible(slot, LATEST, LATEST) != NONE;
+        uint32_t v = heads_[slot].load(std::memory_order_relaxed);
+        while (v != NONE && versions_[v].begin.load(std::memory_order_relaxed) == (PENDING | owner))
+            v = versions_[v].older;
+        heads_[slot].store(v, std::memory_order_release);
+        bool is_live = visible(slot, LATEST, LATEST) != NONE;
+        if (is_live != was_live)
+            live_ = is_live ? live_ + 1 : live_ - 1;
+    }
+
+    // Writer side: from now on, remember the slots that writes touch, so work
+    // done on a copy of the store without write_mutex can be caught up later
+    void track()
+    {
+        tracking_ = true;
+        touched_.clear();
+    }
+
+    // Writer side: stops tracking; returns the slots touched since track()
+    std::vector<uint32_t> untrack()
+    {
+        tracking_ = false;
+        return std::move(touched_);
+    }
+
+    // A new store with slots 0..n-1 of this one holding, per slot, only the
+    // versions a reader can still need from now on: the newest committed one
+    // and any pending ones above it. Slots keep their numbers, so the indexes
+    // stay valid. Reads like a reader does, so writers may go on meanwhile;
+    // the slots they touch are tracked and recopied by catch_up.
+    std::unique_ptr<RowStore> compacted(uint32_t n) const
+    {
+        auto fresh = std::make_unique<RowStore>();
+        for (uint32_t slot = 0; slot < n; ++slot)
+        {
+            fresh->add_slot();
+            fresh->copy_slot(*this, slot);
+        }
+        return fresh;
+    }
+
+    // Writer side of `from`: brings a compacted copy of `from` up to date with
+    // the slots added and the ones touched since from.track()
+    void catch_up(RowStore &from)
+    {
+        for (uint32_t slot = slots(), n = from.slots(); slot < n; ++slot)
+        {
+            add_slot();
+            copy_slot(from, slot);
+        }
+        std::vector<uint32_t> touched = from.untrack();
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        for (uint32_t slot : touched)
+            copy_slot(from, slot);
+        live_ = from.live_;
+    }
+
+    uint32_t chunks() const { return chunk_count_.load(std::memory_order_acquire); }
+    size_t stored(uint32_t chunk) const { return chunks_[chunk].used.load(std::memory_order_acquire); }
+
+    // Appends to hits the (slot, version) of the rows that a reader at ts
+    // sees and that contain `needle`, among those stored in `chunk` from byte
+    // `begin` to about `end`, in storage order. Returns the byte it stopped
+    // at: `end`, moved past the row that crosses it. Large ranges are split
+    // at row boundaries across up to `threads` threads.
+    size_t search(std::string_view needle, uint64_t ts, uint64_t owner, uint32_t chunk, size_t begin, size_t end,
+                  unsigned threads, std::vector<std::pair<uint32_t, uint32_t>> &hits) const
+    {
+        const char *base = chunks_[chunk].base;
+        auto row_end = [&](size_t at) // Cut after the row that crosses `at`
+        {
+            size_t used = stored(chunk);
+            if (at >= used)
+                return used;
+            return static_cast<size_t>(static_cast<const char *>(memchr(base + at - 1, '\n', used - at + 1)) - base) + 1;
+        };
+        end = row_end(end);
+        if (end - begin < PARALLEL_SCAN_BYTES)
+            threads = 1;
+        std::vector<Piece> pieces;
+        size_t piece_bytes = (end - begin) / threads + 1;
+        for (size_t from = begin, to; from < end; from = to)
+        {
+            to = std::min(end, row_end(from + piece_bytes));
+            pieces.push_back({chunk, from, to});
+        }
+        if (pieces.size() <= 1)
+        {
+            for (const Piece &p : pieces)
+                scan(p, needle, ts, owner, hits);
+            return end;
+        }
+        std::vector<std::vector<std::pair<uint32_t, uint32_t>>> found(pieces.size());
+        std::vector<std::thread> pool;
+        for (size_t i = 0; i < pieces.size(); ++i)
+            pool.emplace_back([&, i] { scan(pieces[i], needle, ts, owner, found[i]); });
+        for (std::thread &t : pool)
+            t.join();
+        for (const auto &f : found)
+            hits.insert(hits.end(), f.begin(), f.end());
+        return end;
+    }
+
+private:
+    static constexpr size_t CHUNK_BYTES = size_t(64) << 20;
+    static constexpr size_t PARALLEL_SCAN_BYTES = size_t(4) << 20;
+    static constexpr size_t MAX_CHUNKS = 1 << 14;
+    static constexpr size_t MAX_VERSIONS = size_t(1) << 28; // address space only; pages are touched as used
+    static constexpr size_t MAX_SLOTS = size_t(1) << 28;
+    static constexpr uint32_t TOMBSTONE = UINT32_MAX; // Version::len of a deletion
+
+    struct Version
+    {
+        std::atomic<uint64_t> begin;
+        uint32_t chunk, offset, len;
+        uint32_t older; // previous version of the slot, or NONE
+    };
+    using Owner = std::pair<uint32_t, uint32_t>; // (row start, slot), by row start
+    struct Chunk
+    {
+        char *base = nullptr;
+        size_t capacity = 0;
+        std::atomic<size_t> used{0};
+        Owner *owners = nullptr;
+        size_t owner_capacity = 0;
+        std::atomic<uint32_t> owner_count{0};
+    };
+    struct Piece
+    {
+        uint32_t chunk;
+        size_t begin, end;
+    };
+
+    template <typename T>
+    static T *reserve(size_t count)
+    {
+        void *p = mmap(nullptr, count * sizeof(T), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                       -1, 0);
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+        return static_cast<T *>(p);
+    }
+
+    void touch(uint32_t slot)
+    {
+        if (tracking_)
+            touched_.push_back(slot);
+    }
+
+    // Replaces the versions of `slot` with the ones of `from`'s slot that
+    // compacted() keeps. Nothing reads this store's slot yet.
+    void copy_slot(const RowStore &from, uint32_t slot)
+    {
+        std::vector<uint32_t> chain;
+        for (uint32_t v = from.heads_[slot].load(std::memory_order_acquire); v != NONE; v = from.versions_[v].older)
+        {
+            chain.push_back(v);
+            if (!(from.versions_[v].begin.load(std::memory_order_acquire) & PENDING))
+                break;
+        }
+        if (!chain.empty() && from.versions_[chain.back()].len == TOMBSTONE &&
+            !(from.versions_[chain.back()].begin.load(std::memory_order_acquire) & PENDING))
+            chain.pop_back(); // A committed deletion: nothing left to see
+        heads_[slot].store(NONE, std::memory_order_relaxed);
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+        {
+            std::string_view line = from.versions_[*it].len == TOMBSTONE ? std::string_view() : from.text(*it);
+            push(slot, from.versions_[*it].len == TOMBSTONE ? nullptr : &line,
+                 from.versions_[*it].begin.load(std::memory_order_acquire));
+        }
+    }
+
+    void push(uint32_t slot, const std::string_view *line, uint64_t begin)
+    {
+        uint32_t v = static_cast<uint32_t>(version_count_.load(std::memory_order_relaxed));
+        if (v == MAX_VERSIONS - 1)
+            throw std::length_error("RowStore: too many versions");
+        Version *ver = new (&versions_[v]) Version;
+        ver->begin.store(begin, std::memory_order_relaxed);
+        ver->len = TOMBSTONE;
+        if (line)
+            place(*line, slot, *ver);
+        ver->older = heads_[slot].load(std::memory_order_relaxed);
+        version_count_.store(v + 1, std::memory_order_relaxed);
+        heads_[slot].store(v, std::memory_order_release);
+    }
+
+    // Copies the row bytes to the end of the last chunk (or a new one)
+    void place(std::string_view line, uint32_t slot, Version &ver)
+    {
+        uint32_t n = chunk_count_.load(std::memory_order_relaxed);
+        if (n == 0 || chunks_[n - 1].capacity - chunks_[n - 1].used.load(std::memory_order_relaxed) < line.size() + 1 ||
+            chunks_[n - 1].owner_count.load(std::memory_order_relaxed) == chunks_[n - 1].owner_capacity)
+        {
+            if (n == MAX_CHUNKS)
+                throw std::length_error("RowStore: too many chunks");
+            Chunk &c = chunks_[n];
+            c.capacity = std::max(CHUNK_BYTES, line.size() + 1);
+            c.base = reserve<char>(c.capacity);
+            c.owner_capacity = c.capacity / 16 + 1;
+            c.owners = reserve<Owner>(c.owner_capacity);
+            chunk_count_.store(++n, std::memory_order_release);
+        }
+        Chunk &c = chunks_[n - 1];
+        size_t used = c.used.load(std::memory_order_relaxed);
+        uint32_t owners = c.owner_count.load(std::memory_order_relaxed);
+        memcpy(c.base + used, line.data(), line.size());
+        c.base[used + line.size()] = '\n';
+        c.owners[owners] = {static_cast<uint32_t>(used), slot};
+        c.owner_count.store(owners + 1, std::memory_order_release);
+        c.used.store(used + line.size() + 1, std::memory_order_release);
+        ver.chunk = n - 1;
+        ver.offset = static_cast<uint32_t>(used);
+        ver.len = static_cast<uint32_t>(line.size());
+    }
+
+    void scan(const Piece &p, std::string_view needle, uint64_t ts, uint64_t owner,
+              std::vector<std::pair<uint32_t, uint32_t>> &hits) const
+    {
+        const Chunk &c = chunks_[p.chunk];
+        const Owner *owners = c.owners, *owners_end = owners + c.owner_count.load(std::memory_order_acquire);
+        const char *s = c.base + p.begin, *end = c.base + p.end;
+        while (const char *hit = find_substring(s, end, needle))
+        {
+            const char *nl = static_cast<const char *>(memrchr(s, '\n', hit - s));
+            uint32_t start = static_cast<uint32_t>((nl ? nl + 1 : s) - c.base);
+            const Owner *owner_of = std::lower_bound(owners, owners_end, Owner(start, 0));
+            uint32_t v = visible(owner_of->second, ts, owner);
+            if (v != NONE && versions_[v].chunk == p.chunk && versions_[v].offset == start)
+                hits.emplace_back(owner_of->second, v);
+            s = static_cast<const char *>(memchr(hit, '\n', end - hit)) + 1; // Next row
+        }
+    }
+
+    Version *versions_;
+    std::atomic<uint32_t> *heads_; // newest version of each slot
+    std::unique_ptr<Chunk[]> chunks_;
+    std::atomic<size_t> version_count_{0};
+    std::atomic<uint32_t> slot_count_{0};
+    std::atomic<uint32_t> chunk_count_{0};
+    size_t live_ = 0;
+    bool tracking_ = false;
+    std::vector<uint32_t> touched_; // slots written since track()
+};
+
+// --- Epoch-based reclamation ---
+// A reader pins the current epoch before it loads the table's RowStore and
+// unpins when it is done. A store replaced by compaction is retired under the
+// epoch that was current when it was unlinked, and freed once every pinned
+// epoch is newer: such readers pinned after the unlink and can only have
+// loaded the replacement. A pin also holds the snapshot timestamp its reader
+// reads at, so the table knows the oldest snapshot still in use.
+class Epochs
+{
+public:
+    class Pin
+    {
+    public:
+        explicit Pin(Epochs &epochs) : epochs_(epochs), slot_(epochs.pin()) {}
+        Pin(const Pin &) = delete;
+        Pin &operator=(const Pin &) = delete;
+        ~Pin()
+        {
+            epochs_.slots_[slot_].ts.store(UINT64_MAX);
+            epochs_.slots_[slot_].epoch.store(0);
+        }
+
+        // Publishes the snapshot timestamp the reader reads at
+        void hold(uint64_t ts) { epochs_.slots_[slot_].ts.store(ts); }
+
+    private:
+        Epochs &epochs_;
+        size_t slot_;
+    };
+
+    void retire(RowStore *store)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        retired_.emplace_back(epoch_.fetch_add(1), store);
+        collect_locked();
+    }
+
+    // Oldest snapshot timestamp a pinned reader holds, or UINT64_MAX
+    uint64_t oldest_snapshot() const
+    {
+        uint64_t oldest = UINT64_MAX;
+        for (const Slot &s : slots_)
+            oldest = std::min(oldest, s.ts.load());
+        return oldest;
+    }
+
+    // Frees the retired stores no reader can still hold
+    void collect()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        collect_locked();
+    }
+
+private:
+    static constexpr size_t SLOTS = 4096; // concurrent pins
+
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> epoch{0}; // 0 = free
+        std::atomic<uint64_t> ts{UINT64_MAX}; // UINT64_MAX = none held
+    };
+
+    size_t pin()
+    {
+        static std::atomic<size_t> next_hint{0};
+        thread_local size_t hint = next_hint.fetch_add(1) % SLOTS;
+        for (size_t n = 0;; ++n)
+        {
+            size_t i = (hint + n) % SLOTS;
+            uint64_t free = 0;
+            if (slots_[i].epoch.compare_exchange_strong(free, epoch_.load()))
+            {
+                hint = i;
+                return i;
+            }
+            if (n % SLOTS == SLOTS - 1) // All taken: wait for a reader to finish
+                std::this_thread::yield();
+        }
+    }
+
+    void collect_locked()
+    {
+        uint64_t oldest = UINT64_MAX;
+        for (const Slot &s : slots_)
+        {
+            uint64_t e = s.epoch.load();
+            if (e != 0)
+                oldest = std::min(oldest, e);
+        }
+        auto keep = std::partition(retired_.begin(), retired_.end(),
+                                   [&](const std::pair<uint64_t, RowStore *> &r) { return r.first >= oldest; });
+        for (auto it = keep; it != retired_.end(); ++it)
+            delete it->second;
+        retired_.erase(keep, retired_.end());
+    }
+
+    std::atomic<uint64_t> epoch_{1};
+    Slot slots_[SLOTS];
+    std::mutex mutex_;
+    std::vector<std::pair<uint64_t, RowStore *>> retired_;
+};
+static Epochs g_epochs;
+
+// Size and FNV-1a hash of a file's bytes. Identifies which base file a
+// checkpoint wrote (see the write-ahead log below).
+struct Fingerprint
+{
+    uint64_t size = 0;
+    uint64_t hash = 14695981039346656037ULL;
+
+    void add(const char *data, size_t len)
+    {
+        size += len;
+        for (size_t i = 0; i < len; ++i)
+            hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+    }
+    bool operator==(const Fingerprint &o) const { return size == o.size && hash == o.hash; }
+};
+
+static bool fingerprint_file(const std::string &path, Fingerprint &fp)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    std::vector<char> buf(1 << 20);
+    ssize_t n;
+    while ((n = read(fd, buf.data(), buf.size())) > 0)
+        fp.add(buf.data(), static_cast<size_t>(n));
+    close(fd);
+    return n == 0;
+}
+
+// Writes the header and the given row versions to a CSV file (overwrites existing content)
+// and fsyncs it. If fp is given, it receives the fingerprint of what was written.
+bool write_csv_data(const std::string &path, const std::string &header, const RowStore &rows,
+                    const std::vector<uint32_t> &versions, Fingerprint *fp = nullptr)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+    {
+        std::cerr << "Error: Could not open CSV file for writing: " << path << std::endl;
+        return false;
+    }
+    std::string buf;
+    buf.reserve(1 << 20);
+    bool ok = true;
+    auto flush = [&]
+    {
+        size_t done = 0;
+        while (ok && done < buf.size())
+        {
+            ssize_t n = write(fd, buf.data() + done, buf.size() - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            ok = n > 0;
+            done += n > 0 ? static_cast<size_t>(n) : 0;
+        }
+        if (fp)
+            fp->add(buf.data(), buf.size());
+        buf.clear();
+    };
+    buf += header;
+    buf += '\n';
+    for (uint32_t v : versions)
+    {
+        buf += rows.text(v);
+        buf += '\n';
+        if (buf.size() >= (1 << 20))
+            flush();
+    }
+    flush();
+    ok = fsync(fd) == 0 && ok;
+    ok = close(fd) == 0 && ok;
+    if (!ok)
+        std::cerr << "Error: Could not write CSV file: " << path << " - " << strerror(errno) << std::endl;
+    return ok;
+}
+
+// --- In-memory table ---
+// Loaded once at startup and shared by every handler thread, so commands never
+// re-read the file. ADD/MODIFY/DELETE are added to the table as pending
+// versions of their rows, which only their own transaction sees; COMMIT logs
+// them to the write-ahead log as one record and publishes them all at once
+// under a new commit timestamp, ROLLBACK unlinks them. Reads take no lock on the
+// rows: each one works on a ReadView, a snapshot that no later write changes.
+// Writers are serialized by write_mutex. The header and the indexes are
+// plain maps under index_latch, which writers hold exclusively only for the
+// few map updates of one mutation.
+//
+// Slots are permanent: a deleted row keeps its slot (the ID index still
+// points at it, and an ADD of the same ID reuses it), so compaction never
+// renumbers the slots the indexes store.
+//
+// The ID index describes the latest state, pending writes included, as the
+// writers need it. A MODIFY that changes a row's ID moves the old ID's entry
+// to `moved`, where snapshots that still see the old ID (every other session
+// until the commit, and older snapshots after it) find it: a lookup checks
+// that the version it sees carries the ID, and falls back to `moved`. An
+// entry is dropped once it duplicates the index again (a rollback), or by
+// compaction_loop once no snapshot older than the commit that moved the ID
+// remains.
+//
+// Nombre, Ciudad and Fuente also have an inverted index (value -> slots) for
+// QUERY Col=val. Postings only grow: a MODIFY or DELETE leaves its old entry
+// behind (stale), the query re-checks every candidate row, and a background
+// thread rebuilds the postings once stale entries outnumber the rows.
+struct SecondaryIndex
+{
+    size_t column; // field position in a row
+    std::unordered_map<std::string, std::vector<uint32_t>> postings;
+};
+
+struct Table
+{
+    std::mutex write_mutex;        // serializes writers; readers never take it
+    std::shared_mutex index_latch; // header, index, secondary
+    std::string header;
+    std::atomic<RowStore *> rows{new RowStore}; // data lines, without the header
+    std::atomic<uint64_t> commit_ts{0};         // newest published commit
+    std::unordered_map<int, uint32_t> index;    // ID -> slot in rows
+    std::unordered_multimap<int, uint32_t> moved; // ID -> slot it held before a MODIFY changed the ID
+    std::vector<SecondaryIndex> secondary;
+    size_t stale = 0; // postings entries that no longer match their row
+};
+static Table g_table;
+
+// Threads a full-text QUERY may split a large table across
+static const unsigned g_scan_threads = std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+
+// A consistent snapshot for one read. The store and the commit timestamp are
+// re-read until they belong together, since compaction may swap the store,
+// and until commit_ts is still the timestamp the pin holds, so prune_moved
+// either sees it or finds commit_ts no newer; the pin keeps the store alive
+// until the view goes away. `owner` is the
+// session whose own pending writes the view includes (0 = none).
+struct ReadView
+{
+    Epochs::Pin pin{g_epochs};
+    const RowStore *rows;
+    uint64_t ts;
+    uint64_t owner;
+
+    explicit ReadView(uint64_t owner_id = 0) : owner(owner_id)
+    {
+        do
+        {
+            rows = g_table.rows.load();
+            ts = g_table.commit_ts.load();
+            pin.hold(ts);
+        } while (rows != g_table.rows.load() || ts != g_table.commit_ts.load());
+    }
+};
+
+static const char *DEFAULT_HEADER = "ID,Nombre,Edad,Ciudad,Fuente";
+static const char *INDEXED_COLUMNS[] = {"Nombre", "Ciudad", "Fuente"};
+
+// Field `column` of a CSV line (no quoting, like the rest of the server)
+static bool field_of(std::string_view row, size_t column, std::string_view &field)
+{
+    for (size_t c = 0; c < column; ++c)
+    {
+        size_t comma = row.find(',');
+        if (comma == std::string_view::npos)
+            return false;
+        row.remove_prefix(comma + 1);
+    }
+    field = row.substr(0, row.find(','));
+    return true;
+}
+
+// Position of a header column, or -1
+static long column_of(std::string_view name)
+{
+    std::string_view field;
+    for (size_t c = 0; field_of(g_table.header, c, field); ++c)
+    {
+        if (field == name)
+            return static_cast<long>(c);
+    }
+    return -1;
+}
+
+static void index_secondary(std::vector<SecondaryIndex> &secondary, uint32_t slot, std::string_view row)
+{
+    std::string_view field;
+    for (SecondaryIndex &si : secondary)
+    {
+        if (field_of(row, si.column, field))
+            si.postings[std::string(field)].push_back(slot);
+    }
+}
+
+// Parses the leading ID field of a row. Returns false if it is not a number.
+static bool row_id(std::string_view row, int &id)
+{
+    const char *end = row.data() + row.size();
+    auto res = std::from_chars(row.data(), end, id);
+    return res.ec == std::errc() && (res.ptr == end || *res.ptr == ',');
+}
+
+// Postings of the versions of `slot` a reader from now on may see: the one
+// committed at ts and a pending one.
+static void index_versions(std::vector<SecondaryIndex> &secondary, const RowStore &rows, uint32_t slot, uint64_t ts)
+{
+    uint32_t committed = rows.visible(slot, ts), latest = rows.visible(slot, RowStore::LATEST, RowStore::LATEST);
+    if (committed != RowStore::NONE)
+        index_secondary(secondary, slot, rows.text(committed));
+    if (latest != committed && latest != RowStore::NONE)
+        index_secondary(secondary, slot, rows.text(latest));
+}
+
+// Empty postings for the indexed columns of the header. Caller holds
+// write_mutex or index_latch.
+static std::vector<SecondaryIndex> secondary_columns()
+{
+    std::vector<SecondaryIndex> secondary;
+    for (const char *name : INDEXED_COLUMNS)
+    {
+        long column = column_of(name);
+        if (column >= 0)
+            secondary.push_back({static_cast<size_t>(column), {}});
+    }
+    return secondary;
+}
+
+// Fresh postings for every row. Caller holds write_mutex.
+static std::vector<SecondaryIndex> build_secondary(const RowStore &rows)
+{
+    std::vector<SecondaryIndex> secondary = secondary_columns();
+    uint64_t ts = g_table.commit_ts.load();
+    for (uint32_t slot = 0, n = rows.slots(); slot < n; ++slot)
+        index_versions(secondary, rows, slot, ts);
+    return secondary;
+}
+
+// Table maintenance, run by compaction_loop rather than by the writers, so a
+// commit never waits for an O(table) pass. Each pass takes write_mutex only
+// to start tracking the slots writes touch and, at the end, to redo those
+// slots and swap the result in; the bulk of the work reads the store the way
+// a reader does while the writers go on.
+
+// Rebuilds the postings once stale entries outnumber the rows. Indexed reads
+// only wait for the swap.
+static void rebuild_secondary()
+{
+    RowStore *rows; // compaction_loop alone swaps the store, so it stays put
+    uint64_t ts;
+    std::vector<SecondaryIndex> secondary;
+    {
+        std::lock_guard<std::mutex> lock(g_table.write_mutex);
+        rows = g_table.rows.load();
+        if (g_table.stale <= rows->slots())
+            return;
+        rows->track();
+        ts = g_table.commit_ts.load();
+        secondary = secondary_columns();
+    }
+    uint32_t n = rows->slots();
+    for (uint32_t slot = 0; slot < n; ++slot)
+        index_versions(secondary, *rows, slot, ts);
+
+    std::lock_guard<std::mutex> lock(g_table.write_mutex);
+    ts = g_table.commit_ts.load();
+    for (uint32_t slot : rows->untrack())
+        index_versions(secondary, *rows, slot, ts); // Entries the pass already made are only stale ones
+    for (uint32_t slot = n, end = rows->slots(); slot < end; ++slot)
+        index_versions(secondary, *rows, slot, ts);
+    std::unique_lock<std::shared_mutex> latch(g_table.index_latch);
+    g_table.secondary.swap(secondary);
+    g_table.stale = 0;
+}
+
+// Replaces the store with a compacted copy once superseded versions outnumber
+// the rows, or the versions the last copy kept (an open transaction's pending
+// ones cannot be dropped, and recopying them would gain nothing). Readers
+// that loaded the old store keep using it; it is freed when the last of them
+// is done. The catch-up and the swap happen under
+// write_mutex, so no commit moves commit_ts meanwhile and the copy holds
+// everything a ReadView taken after the swap can see.
+static void compact_table()
+{
+    static size_t kept = 0; // versions in the last copy
+    RowStore *old_rows;
+    uint32_t n;
+    {
+        std::lock_guard<std::mutex> lock(g_table.write_mutex);
+        old_rows = g_table.rows.load();
+        if (old_rows->versions() < 2 * std::max(old_rows->size(), kept) + 4096)
+            return;
+        old_rows->track();
+        n = old_rows->slots();
+    }
+    std::unique_ptr<RowStore> fresh = old_rows->compacted(n); // compaction_loop alone retires the store
+
+    std::lock_guard<std::mutex> lock(g_table.write_mutex);
+    fresh->catch_up(*old_rows);
+    kept = fresh->versions();
+    g_table.rows.store(fresh.release());
+    g_epochs.retire(old_rows);
+}
+
+// Indexes the loaded rows. Returns how many rows repeat an ID already seen;
+// lookups resolve those to the first one, as the old linear scan did.
+static size_t index_table()
+{
+    const RowStore &rows = *g_table.rows.load();
+    size_t duplicates = 0;
+    g_table.index.clear();
+    g_table.moved.clear();
+    g_table.index.reserve(rows.slots());
+    for (uint32_t slot = 0, n = rows.slots(); slot < n; ++slot)
+    {
+        int id;
+        uint32_t v = rows.visible(slot, RowStore::LATEST, RowStore::LATEST);
+        if (v != RowStore::NONE && row_id(rows.text(v), id))
+            duplicates += !g_table.index.emplace(id, slot).second;
+    }
+    g_table.secondary = build_secondary(rows);
+    g_table.stale = 0;
+    return duplicates;
+}
+
+// Loads a snapshot straight into the store and the indexes: each row is
+// formatted once into the store, its ID comes from the ID column, and an
+// indexed dictionary column finds the postings of each code once. Returns
+// how many rows repeat an ID, like index_table().
+static size_t load_snapshot(const Snapshot &snap)
+{
+    g_table.header = snap.header();
+    g_table.secondary = secondary_columns();
+    RowStore &rows = *g_table.rows.load();
+    std::vector<std::vector<std::vector<uint32_t> *>> postings_of(g_table.secondary.size()); // [index][code]
+    for (size_t k = 0; k < g_table.secondary.size(); ++k)
+        postings_of[k].assign(snap.dictionary(g_table.secondary[k].column).size(), nullptr);
+    g_table.index.reserve(snap.rows());
+
+    size_t duplicates = 0;
+    std::string line;
+    char number[24];
+    for (uint64_t r = 0; r < snap.rows(); ++r)
+    {
+        uint32_t slot = rows.add_slot();
+        rows.write(slot, snap.row(r, line), 0);
+        int id;
+        if (snap.id(r, id))
+            duplicates += !g_table.index.emplace(id, slot).second;
+        for (size_t k = 0; k < g_table.secondary.size(); ++k)
+        {
+            SecondaryIndex &si = g_table.secondary[k];
+            if (postings_of[k].empty())
+            {
+                si.postings[std::string(snap.cell(r, si.column, number))].push_back(slot);
+                continue;
+            }
+            uint32_t code = snap.code(r, si.column);
+            if (!postings_of[k][code])
+                postings_of[k][code] = &si.postings[std::string(snap.dictionary(si.column)[code])];
+            postings_of[k][code]->push_back(slot);
+        }
+    }
+    return duplicates;
+}
+
+// Returns false if the file is a snapshot that cannot be loaded: starting
+// empty over it would let the first checkpoint overwrite it. A missing file
+// is an empty table.
+static bool load_table(const std::string &path)
+{
+    size_t duplicates = 0;
+    Snapshot snap;
+    switch (snap.open(path))
+    {
+    case Snapshot::BAD:
+        return false;
+    case Snapshot::OK:
+        duplicates = load_snapshot(snap);
+        break;
+    case Snapshot::NOT_SNAPSHOT:
+    {
+        std::vector<std::string> data = read_csv_data(path);
+        if (data.empty())
+            return true;
+        g_table.header = std::move(data[0]);
+        RowStore &rows = *g_table.rows.load();
+        for (size_t i = 1; i < data.size(); ++i)
+            rows.write(rows.add_slot(), data[i], 0);
+        data.clear();
+        duplicates = index_table();
+        break;
+    }
+    }
+    if (duplicates)
+        std::cerr << "Warning: " << duplicates << " rows repeat an existing ID; GET/MODIFY/DELETE reach only the first one."
+                  << std::endl;
+    return true;
+}
+
+// Slot of the row with the given ID, or -1. Caller holds index_latch.
+static long find_row(int id)
+{
+    auto it = g_table.index.find(id);
+    return it == g_table.index.end() ? -1 : static_cast<long>(it->second);
+}
+
+// Version of the row with the given ID that `view` sees, or NONE; its slot
+// goes to *slot_out. Caller holds index_latch.
+static uint32_t lookup(const ReadView &view, int id, uint32_t *slot_out = nullptr)
+{
+    auto holds = [&](uint32_t slot)
+    {
+        uint32_t v = view.rows->visible(slot, view.ts, view.owner);
+        int current;
+        if (v == RowStore::NONE || !row_id(view.rows->text(v), current) || current != id)
+            return RowStore::NONE;
+        if (slot_out)
+            *slot_out = slot;
+        return v;
+    };
+    long slot = find_row(id);
+    uint32_t v = slot >= 0 ? holds(static_cast<uint32_t>(slot)) : RowStore::NONE;
+    for (auto range = g_table.moved.equal_range(id); v == RowStore::NONE && range.first != range.second; ++range.first)
+        v = holds(range.first->second); // The view predates a change of the ID
+    return v;
+}
+
+// Points the ID index entry of `id` at `slot` (-1 erases it). A replaced
+// entry goes to `moved` for the snapshots that still see it. Caller holds
+// index_latch exclusively.
+static void set_row(int id, long slot)
+{
+    auto it = g_table.index.find(id);
+    if (it != g_table.index.end() && static_cast<long>(it->second) != slot)
+        g_table.moved.emplace(id, it->second);
+    if (slot < 0)
+    {
+        if (it != g_table.index.end())
+            g_table.index.erase(it);
+    }
+    else
+    {
+        g_table.index[id] = static_cast<uint32_t>(slot);
+    }
+}
+
+// True if `line` starts with an ID that belongs to a row other than `slot`
+// in `view`. Caller holds index_latch.
+static bool id_taken(const ReadView &view, std::string_view line, long slot = -1)
+{
+    int id;
+    uint32_t holder;
+    return row_id(line, id) && lookup(view, id, &holder) != RowStore::NONE && static_cast<long>(holder) != slot;
+}
+
+struct Predicate
+{
+    size_t column;
+    std::string value;
+};
+
+// Parses "Col=val [AND Col=val ...]" against the header. Returns false if the
+// term is not in that form, so QUERY falls back to a substring search.
+// Caller holds index_latch.
+static bool parse_predicates(const std::string &term, std::vector<Predicate> &predicates)
+{
+    static const std::string AND = " AND ";
+    auto trim = [](std::string_view v)
+    {
+        while (!v.empty() && v.front() == ' ')
+            v.remove_prefix(1);
+        while (!v.empty() && v.back() == ' ')
+            v.remove_suffix(1);
+        return v;
+    };
+    size_t pos = 0;
+    while (pos <= term.size())
+    {
+        size_t next = term.find(AND, pos);
+        std::string_view part(term.data() + pos, (next == std::string::npos ? term.size() : next) - pos);
+        size_t eq = part.find('=');
+        if (eq == std::string_view::npos)
+            return false;
+        long column = column_of(trim(part.substr(0, eq)));
+        if (column < 0)
+            return false;
+        predicates.push_back({static_cast<size_t>(column), std::string(trim(part.substr(eq + 1)))});
+        if (next == std::string::npos)
+            break;
+        pos = next + AND.size();
+    }
+    return !predicates.empty();
+}
+
+// --- Streaming queries ---
+// A QUERY runs a window of slots (or of stored row text) at a time, so its
+// memory stays bounded however many rows match: fill() produces the response
+// in pieces that the handler sends as it goes. Substring matches come in
+// storage order, so a modified row is listed after the untouched ones.
+// The same object is a server-side cursor (OPEN_CURSOR/FETCH), kept between
+// requests; it reads the snapshot it was opened on, whose row store stays
+// pinned until the cursor is closed.
+static const size_t STREAM_PIECE_BYTES = 64 * 1024;
+static const size_t QUERY_WINDOW_SLOTS = 1 << 18;         // slots checked per step
+static const size_t QUERY_WINDOW_BYTES = size_t(16) << 20; // row text searched per step
+static const size_t MAX_INDEX_CANDIDATES = 1 << 16; // longer postings are not copied; the query scans instead
+
+class QueryCursor
+{
+public:
+    // Rows `offset` on of the result, at most `limit` of them. Column
+    // queries take their candidates from the ID index or the smallest
+    // inverted index among the predicates, if it is short enough to copy.
+    // Caller holds index_latch.
+    QueryCursor(const std::string &term, uint64_t owner, size_t offset, size_t limit)
+        : view_(owner), term_(term), header_(g_table.header), end_slot_(view_.rows->slots()),
+          end_chunk_(view_.rows->chunks()), skip_(offset), left_(limit)
+    {
+        if (!parse_predicates(term, predicates_))
+        {
+            predicates_.clear(); // Substring search
+            return;
+        }
+        const std::vector<uint32_t> *best = nullptr;
+        std::vector<uint32_t> by_id;
+        for (const Predicate &p : predicates_)
+        {
+            int id;
+            if (p.column == 0 && row_id(p.value, id) && std::to_string(id) == p.value)
+            {
+                uint32_t slot;
+                if (lookup(view_, id, &slot) != RowStore::NONE)
+                    by_id.push_back(slot);
+                best = &by_id;
+                break;
+            }
+            for (const SecondaryIndex &si : g_table.secondary)
+            {
+                if (si.column != p.column)
+                    continue;
+                auto it = si.postings.find(p.value);
+                static const std::vector<uint32_t> none;
+                const std::vector<uint32_t> *list = it == si.postings.end() ? &none : &it->second;
+                if (!best || list->size() < best->size())
+                    best = list;
+            }
+        }
+        if (best && best->size() <= MAX_INDEX_CANDIDATES)
+        {
+            candidates_ = *best;
+            std::sort(candidates_.begin(), candidates_.end()); // A modified row can be listed twice
+            candidates_.erase(std::unique(candidates_.begin(), candidates_.end()), candidates_.end());
+            indexed_ = true;
+        }
+    }
+
+    // Starts the response to one request: at most `rows` rows, or
+    // `empty_message` if there are none.
+    void begin_response(size_t rows, std::string empty_message)
+    {
+        batch_left_ = rows;
+        empty_message_ = std::move(empty_message);
+        responded_ = false;
+    }
+
+    // Appends the next part of the response to out, stopping once about
+    // `budget` bytes were added. Returns false when the response is complete.
+    bool fill(std::string &out, size_t budget)
+    {
+        size_t start = out.size();
+        while (left_ > 0 && batch_left_ > 0)
+        {
+            if (out.size() - start >= budget)
+                return true;
+            if (pos_ == window_.size() && !next_window())
+                break;
+            uint32_t v = window_[pos_++].second;
+            if (skip_ > 0)
+            {
+                --skip_;
+                continue;
+            }
+            if (!responded_)
+            {
+                out += header_; // Include header in query response
+                out += '\n';
+                responded_ = true;
+            }
+            out += view_.rows->text(v);
+            out += '\n';
+            --left_;
+            --batch_left_;
+        }
+        if (!responded_)
+            out += empty_message_;
+        return false;
+    }
+
+private:
+    // Loads the hits of the next window of slots (or candidates). Returns
+    // false once the whole table was searched.
+    bool next_window()
+    {
+        window_.clear();
+        pos_ = 0;
+        while (window_.empty())
+        {
+            if (indexed_)
+            {
+                if (next_ == candidates_.size())
+                    return false;
+                size_t end = std::min(candidates_.size(), next_ + QUERY_WINDOW_SLOTS);
+                for (; next_ < end; ++next_)
+                    match(candidates_[next_]);
+                continue;
+            }
+            if (!predicates_.empty() || term_.empty())
+            {
+                if (next_ == end_slot_)
+                    return false;
+                size_t last = std::min(end_slot_, next_ + QUERY_WINDOW_SLOTS);
+                for (; next_ < last; ++next_)
+                    match(static_cast<uint32_t>(next_));
+                continue;
+            }
+            // Substring search: through the stored text, a window of bytes at
+            // a time, checking visibility only on the rows that contain it
+            while (chunk_ < end_chunk_ && next_ >= view_.rows->stored(chunk_))
+            {
+                ++chunk_;
+                next_ = 0;
+            }
+            if (chunk_ == end_chunk_)
+                return false;
+            next_ = view_.rows->search(term_, view_.ts, view_.owner, chunk_, next_, next_ + QUERY_WINDOW_BYTES,
+                                       g_scan_threads, window_);
+        }
+        return true;
+    }
+
+    // Adds the slot to the window if the row the view sees matches every predicate
+    void match(uint32_t slot)
+    {
+        uint32_t v = view_.rows->visible(slot, view_.ts, view_.owner);
+        if (v == RowStore::NONE)
+            return;
+        std::string_view row = view_.rows->text(v), field;
+        for (const Predicate &p : predicates_)
+        {
+            if (!field_of(row, p.column, field) || field != p.value)
+                return;
+        }
+        window_.emplace_back(slot, v);
+    }
+
+    ReadView view_;
+    std::string term_;
+    std::string header_;
+    std::vector<Predicate> predicates_;
+    bool indexed_ = false;
+    std::vector<uint32_t> candidates_; // Sorted slots to check, when indexed_
+    size_t end_slot_;                  // Slots past it are newer than the view
+    uint32_t end_chunk_;               // Likewise for chunks of row text
+    uint32_t chunk_ = 0;               // Chunk being searched, for a substring
+    size_t next_ = 0;                  // Next slot, candidate or byte of chunk_ to search
+    std::vector<std::pair<uint32_t, uint32_t>> window_; // (slot, version) hits of the current window
+    size_t pos_ = 0;
+    size_t skip_, left_;                // OFFSET still to skip, LIMIT still to send
+    size_t batch_left_ = SIZE_MAX;      // Rows the current response may still add
+    std::string empty_message_;
+    bool responded_ = false;
+};
+
+// Takes trailing "LIMIT <n>" and "OFFSET <m>" clauses off a QUERY term
+static void take_paging(std::string &term, size_t &offset, size_t &limit)
+{
+    while (!term.empty() && term.back() == ' ')
+        term.pop_back();
+    while (true)
+    {
+        size_t space = term.rfind(' ');
+        if (space == std::string::npos || space == 0)
+            return;
+        size_t value;
+        const char *end = term.data() + term.size();
+        auto res = std::from_chars(term.data() + space + 1, end, value);
+        if (res.ec != std::errc() || res.ptr != end)
+            return;
+        size_t keyword = term.rfind(' ', space - 1);
+        keyword = keyword == std::string::npos ? 0 : keyword + 1;
+        std::string_view word(term.data() + keyword, space - keyword);
+        if (word == "LIMIT")
+            limit = value;
+        else if (word == "OFFSET")
+            offset = value;
+        else
+            return;
+        term.erase(keyword);
+        while (!term.empty() && term.back() == ' ')
+            term.pop_back();
+    }
+}
+
+// Applies one mutation to the table as a version that becomes visible at
+// `begin`: 0 during recovery, PENDING|session id inside a transaction.
+// The touched slot goes to `written`, for the commit to publish. Caller holds
+// write_mutex. Payloads: "A <line>", "M <id> <line>", "D <id>".
+static bool apply_mutation(const std::string &payload, uint64_t begin, std::vector<uint32_t> *written)
+{
+    if (payload.size() < 2 || payload[1] != ' ')
+        return false;
+    RowStore &rows = *g_table.rows.load();
+    // The writer's view: everything committed plus every pending write, the
+    // row locks of the writers keep those disjoint
+    ReadView latest(RowStore::LATEST);
+    latest.ts = RowStore::LATEST;
+    uint32_t slot;
+    {
+        std::unique_lock<std::shared_mutex> latch(g_table.index_latch);
+        if (payload[0] == 'A')
+        {
+            std::string_view line(payload.data() + 2, payload.size() - 2);
+            if (id_taken(latest, line))
+                return false;
+            if (g_table.header.empty())
+            { // If file was empty, start it with the default header
+                g_table.header = DEFAULT_HEADER;
+                g_table.secondary = build_secondary(rows); // Picks up the indexed columns
+            }
+            int new_id;
+            bool has_id = row_id(line, new_id);
+            long reuse = has_id ? find_row(new_id) : -1;
+            // A deleted row's slot is reused by an ADD of its ID
+            slot = reuse >= 0 && rows.visible(reuse, RowStore::LATEST, RowStore::LATEST) == RowStore::NONE
+                       ? static_cast<uint32_t>(reuse)
+                       : rows.add_slot();
+            if (has_id)
+                set_row(new_id, slot);
+            rows.write(slot, line, begin);
+            index_secondary(g_table.secondary, slot, line);
+        }
+        else
+        {
+            int id;
+            const char *start = payload.data() + 2, *end = payload.data() + payload.size();
+            auto res = std::from_chars(start, end, id);
+            if (res.ec != std::errc())
+                return false;
+            uint32_t current = lookup(latest, id);
+            if (current == RowStore::NONE)
+                return false;
+            slot = static_cast<uint32_t>(find_row(id));
+            if (payload[0] == 'M' && res.ptr < end && *res.ptr == ' ')
+            {
+                std::string_view line(res.ptr + 1, end - res.ptr - 1);
+                if (line.empty() || id_taken(latest, line, slot))
+                    return false;
+                int new_id;
+                if (row_id(line, new_id) && new_id != id)
+                { // The new line carries another ID
+                    set_row(id, -1);
+                    set_row(new_id, slot);
+                }
+                std::string_view old_field, new_field;
+                for (SecondaryIndex &si : g_table.secondary)
+                {
+                    bool had = field_of(rows.text(current), si.column, old_field);
+                    bool has = field_of(line, si.column, new_field);
+                    if (had && has && old_field == new_field)
+                        continue;
+                    g_table.stale += had;
+                    if (has)
+                        si.postings[std::string(new_field)].push_back(slot);
+                }
+                rows.write(slot, line, begin);
+            }
+            else if (payload[0] == 'D')
+            {
+                rows.remove(slot, begin);
+                g_table.stale += g_table.secondary.size();
+            }
+            else
+            {
+                return false;
+            }
+        }
+    }
+    if (written)
+        written->push_back(slot);
+    return true;
+}
+
+// The version of every row committed at ts: the state the write-ahead log
+// describes once commits up to ts are logged. Caller keeps commits out.
+static std::vector<uint32_t> committed_versions(const RowStore &rows, uint64_t ts)
+{
+    std::vector<uint32_t> versions;
+    versions.reserve(rows.size());
+    for (uint32_t slot = 0, n = rows.slots(); slot < n; ++slot)
+    {
+        uint32_t v = rows.visible(slot, ts);
+        if (v != RowStore::NONE)
+            versions.push_back(v);
+    }
+    return versions;
+}
+
+// Makes a transaction's pending versions visible to every reader at once.
+// Caller holds write_mutex.
+static void publish_writes(uint64_t owner, std::vector<uint32_t> &written)
+{
+    RowStore &rows = *g_table.rows.load();
+    uint64_t ts = g_table.commit_ts.load() + 1;
+    for (uint32_t slot : written)
+        rows.publish(slot, owner, ts);
+    g_table.commit_ts.store(ts); // Readers taking a snapshot from here on see them
+    written.clear();
+}
+
+// Undoes a transaction: its pending versions go away and the ID index points
+// each touched ID back at the row that holds it. The row locks are still held,
+// so every touched row is back to its committed version.
+static void discard_writes(uint64_t owner, std::vector<uint32_t> &written, const std::vector<std::string> &write_set)
+{
+    std::lock_guard<std::mutex> lock(g_table.write_mutex);
+    std::unique_lock<std::shared_mutex> latch(g_table.index_latch);
+    RowStore &rows = *g_table.rows.load();
+    for (uint32_t slot : written)
+        rows.discard(slot, owner);
+    // IDs the transaction gave a slot: an ADD, or a MODIFY to another ID
+    for (const std::string &payload : write_set)
+    {
+        size_t line = payload[0] == 'A' ? 2 : payload[0] == 'M' ? payload.find(' ', 2) + 1 : 0;
+        int id;
+        if (line == 0 || !row_id(std::string_view(payload).substr(line), id))
+            continue;
+        auto it = g_table.index.find(id);
+        if (it == g_table.index.end())
+            continue;
+        uint32_t v = rows.visible(it->second, RowStore::LATEST, RowStore::LATEST);
+        int current;
+        if (v != RowStore::NONE && (!row_id(rows.text(v), current) || current != id))
+            g_table.index.erase(it); // The slot is back to another ID
+    }
+    // IDs a MODIFY moved away from get their slot back
+    for (uint32_t slot : written)
+    {
+        uint32_t v = rows.visible(slot, RowStore::LATEST, RowStore::LATEST);
+        int id;
+        if (v == RowStore::NONE || !row_id(rows.text(v), id))
+            continue;
+        g_table.index[id] = slot;
+        for (auto range = g_table.moved.equal_range(id); range.first != range.second;)
+            range.first = range.first->second == slot ? g_table.moved.erase(range.first) : std::next(range.first);
+    }
+    g_table.stale += written.size() * g_table.secondary.size(); // Postings of the undone versions
+    written.clear();
+}
+
+// --- Bulk load ---
+// LOAD <path> (a CSV or binary snapshot on the server's disk) and BULK_ADD
+// (rows sent as the requests up to END_BULK) add many rows as one transaction
+// that skips the per-row path. The rows are split and their IDs parsed on
+// several threads, checked against each other and the ID index in one pass,
+// logged as one "B" record and published under one commit timestamp. The
+// indexes take them at the end, a batch per index_latch hold, so readers are
+// never held up for the whole load. A load takes no row locks: it refuses
+// IDs with pending versions, and writers serialize behind it.
+static const size_t BULK_INDEX_BATCH = 1 << 16;
+static const size_t MAX_BULK_BYTES = size_t(1) << 30; // BULK_ADD rows a session may buffer
+static const size_t BULK_RECORD_PIECE = 1 << 20;      // Bytes of the log record built at a time
+
+// The rows are read in place: views into the text they came in (a mapped
+// file, the session's BULK_ADD buffer or a log record), or formatted on
+// demand from a snapshot, so a load never holds a second copy of its input.
+struct BulkLoad
+{
+    std::string header;                 // The rows' header line, if they came with one
+    std::vector<std::string_view> rows; // Into the text loaded; unused for a snapshot
+    const Snapshot *snapshot = nullptr; // Row i is its row i instead
+    std::vector<int> ids;               // Of the rows, in the same order
+    std::vector<int> sorted_ids;
+    std::vector<uint32_t> slots;        // Deleted row reused by each row, or NONE; then where it went
+
+    size_t size() const { return ids.size(); }
+
+    // Row i, built in `line` if it comes from a snapshot
+    std::string_view row(size_t i, std::string &line) const { return snapshot ? snapshot->row(i, line) : rows[i]; }
+};
+
+// Runs body(begin, end) over [0, n) split in up to `threads` ranges, one
+// thread each; small ranges stay on the calling thread
+static void parallel_ranges(size_t n, unsigned threads, const std::function<void(size_t, size_t)> &body)
+{
+    threads = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, n / BULK_INDEX_BATCH)));
+    if (threads == 1)
+    {
+        body(0, n);
+        return;
+    }
+    std::vector<std::thread> pool;
+    size_t step = (n + threads - 1) / threads;
+    for (unsigned t = 0; t < threads; ++t)
+        pool.emplace_back([&, t] { body(std::min(n, t * step), std::min(n, (t + 1) * step)); });
+    for (std::thread &t : pool)
+        t.join();
+}
+
+// Splits `text` into rows and parses their IDs, in parallel for large texts.
+// '\r' and blank lines are dropped; a first line without a numeric ID is the
+// header. Returns an error message, or "".
+static std::string parse_bulk(std::string_view text, BulkLoad &load)
+{
+    while (!text.empty() && (text[0] == '\n' || text[0] == '\r'))
+        text.remove_prefix(1);
+    size_t first_end = std::min(text.find('\n'), text.size());
+    std::string_view first = text.substr(0, first_end);
+    if (!first.empty() && first.back() == '\r')
+        first.remove_suffix(1);
+    int id;
+    if (!first.empty() && !row_id(first, id))
+    {
+        load.header = std::string(first);
+        text.remove_prefix(std::min(text.size(), first_end + 1));
+    }
+    if (text.size() > UINT32_MAX / 2)
+        return "ERROR: Too much data for one bulk load.\n";
+
+    // Pieces of about equal size, cut after a newline
+    struct Piece
+    {
+        std::string_view text;
+        std::vector<std::string_view> rows;
+        std::vector<int> ids, sorted;
+        size_t lines = 0, bad_line = 0; // 1-based, 0 = none
+        std::string_view bad;
+    };
+    unsigned threads = text.size() < (size_t(4) << 20) ? 1 : g_scan_threads;
+    std::vector<Piece> pieces;
+    for (size_t begin = 0, end; begin < text.size(); begin = end)
+    {
+        end = std::min(text.size(), begin + text.size() / threads + 1);
+        end = std::min(text.size(), text.find('\n', end - 1) + 1); // npos + 1 == 0
+        if (end == 0)
+            end = text.size();
+        pieces.push_back({text.substr(begin, end - begin), {}, {}, {}, 0, 0, {}});
+    }
+    auto parse_piece = [](Piece &p)
+    {
+        for (size_t pos = 0, end; pos < p.text.size(); pos = end + 1)
+        {
+            end = std::min(p.text.find('\n', pos), p.text.size());
+            std::string_view line = p.text.substr(pos, end - pos);
+            ++p.lines;
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            if (line.empty())
+                continue;
+            int row;
+            if (!row_id(line, row))
+            {
+                p.bad_line = p.lines;
+                p.bad = line;
+                break;
+            }
+            p.rows.push_back(line);
+            p.ids.push_back(row);
+        }
+        p.sorted = p.ids;
+        std::sort(p.sorted.begin(), p.sorted.end());
+    };
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < pieces.size(); ++i)
+        pool.emplace_back(parse_piece, std::ref(pieces[i]));
+    if (!pieces.empty())
+        parse_piece(pieces[0]);
+    for (std::thread &t : pool)
+        t.join();
+
+    size_t lines = load.header.empty() ? 0 : 1, count = 0;
+    for (const Piece &p : pieces)
+    {
+        if (p.bad_line)
+            return "ERROR: Line " + std::to_string(lines + p.bad_line) + " does not start with a numeric ID: " +
+                   std::string(p.bad.substr(0, 80)) + "\n";
+        lines += p.lines;
+        count += p.ids.size();
+    }
+    load.rows.reserve(count);
+    load.ids.reserve(count);
+    load.sorted_ids.reserve(count);
+    for (Piece &p : pieces)
+    {
+        load.rows.insert(load.rows.end(), p.rows.begin(), p.rows.end());
+        std::vector<std::string_view>().swap(p.rows);
+        load.ids.insert(load.ids.end(), p.ids.begin(), p.ids.end());
+        size_t middle = load.sorted_ids.size();
+        load.sorted_ids.insert(load.sorted_ids.end(), p.sorted.begin(), p.sorted.end());
+        std::inplace_merge(load.sorted_ids.begin(), load.sorted_ids.begin() + middle, load.sorted_ids.end());
+    }
+    return "";
+}
+
+// Takes the rows of a snapshot, IDs from its ID column. Returns an error
+// message, or "".
+static std::string parse_bulk(const Snapshot &snap, BulkLoad &load)
+{
+    load.header = snap.header();
+    load.snapshot = &snap;
+    load.ids.resize(snap.rows());
+    for (uint64_t r = 0; r < snap.rows(); ++r)
+    {
+        if (!snap.id(r, load.ids[r]))
+        {
+            std::string line;
+            return "ERROR: Line " + std::to_string(r + 2) + " does not start with a numeric ID: " +
+                   std::string(snap.row(r, line).substr(0, 80)) + "\n";
+        }
+    }
+    load.sorted_ids = load.ids;
+    std::sort(load.sorted_ids.begin(), load.sorted_ids.end());
+    return "";
+}
+
+// Checks a parsed load against the table: matching columns, IDs unique among
+// the rows and not taken in the table, nor touched by an open transaction.
+// Fills load.slots. Returns an error message, or "". Caller holds
+// write_mutex, so the index holds still without the latch.
+static std::string check_bulk(BulkLoad &load)
+{
+    if (!load.header.empty() && !g_table.header.empty() && load.header != g_table.header)
+        return "ERROR: The rows' header '" + load.header + "' does not match the table's '" + g_table.header + "'.\n";
+    auto repeated = std::adjacent_find(load.sorted_ids.begin(), load.sorted_ids.end());
+    if (repeated != load.sorted_ids.end())
+        return "ERROR: ID " + std::to_string(*repeated) + " appears more than once in the rows.\n";
+
+    const RowStore &rows = *g_table.rows.load();
+    load.slots.assign(load.ids.size(), RowStore::NONE);
+    std::atomic<size_t> taken{SIZE_MAX}, busy{SIZE_MAX}; // An offending row; any will do
+    parallel_ranges(load.ids.size(), g_scan_threads, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            // A slot the ID left by a MODIFY that is still open still holds it
+            for (auto range = g_table.moved.equal_range(load.ids[i]); range.first != range.second; ++range.first)
+            {
+                uint32_t committed = rows.visible(range.first->second, RowStore::LATEST);
+                int current;
+                if (rows.pending(range.first->second) && committed != RowStore::NONE &&
+                    row_id(rows.text(committed), current) && current == load.ids[i])
+                    busy = i;
+            }
+            long slot = find_row(load.ids[i]);
+            if (slot < 0)
+                continue;
+            if (rows.pending(static_cast<uint32_t>(slot)))
+                busy = i;
+            else if (rows.visible(static_cast<uint32_t>(slot), RowStore::LATEST) != RowStore::NONE)
+                taken = i;
+            else
+                load.slots[i] = static_cast<uint32_t>(slot); // A deleted row's slot is reused, as ADD does
+        }
+    });
+    if (taken != SIZE_MAX)
+        return "ERROR: A record with ID " + std::to_string(load.ids[taken]) + " already exists.\n";
+    if (busy != SIZE_MAX)
+        return "ERROR: Record ID " + std::to_string(load.ids[busy]) + " is being changed by an open transaction.\n";
+    return "";
+}
+
+// Adds a checked load to the table as versions visible from `begin` (0
+// during recovery). Caller holds write_mutex and publishes `begin`.
+static void apply_bulk(BulkLoad &load, uint64_t begin)
+{
+    RowStore &rows = *g_table.rows.load();
+    std::string line;
+    for (size_t i = 0; i < load.size(); ++i)
+    {
+        if (load.slots[i] == RowStore::NONE)
+            load.slots[i] = rows.add_slot();
+        rows.write(load.slots[i], load.row(i, line), begin);
+    }
+    if (g_table.header.empty())
+    {
+        std::unique_lock<std::shared_mutex> latch(g_table.index_latch);
+        g_table.header = load.header.empty() ? DEFAULT_HEADER : load.header;
+        g_table.secondary = build_secondary(rows); // Picks up the indexed columns
+    }
+    {
+        std::unique_lock<std::shared_mutex> latch(g_table.index_latch);
+        g_table.index.reserve(g_table.index.size() + load.size());
+    }
+    for (size_t batch = 0; batch < load.size(); batch += BULK_INDEX_BATCH)
+    {
+        std::unique_lock<std::shared_mutex> latch(g_table.index_latch);
+        for (size_t i = batch, end = std::min(load.size(), batch + BULK_INDEX_BATCH); i < end; ++i)
+        {
+            g_table.index[load.ids[i]] = load.slots[i];
+            index_secondary(g_table.secondary, load.slots[i], load.row(i, line));
+        }
+    }
+}
+
+// Feeds the load's log record, "B\n<header>\n<row>\n<row>\n...", to `out`
+// in pieces of about BULK_RECORD_PIECE bytes
+static bool bulk_record(const BulkLoad &load, const std::function<bool(std::string_view)> &out)
+{
+    std::string piece = "B\n" + load.header + "\n", line;
+    piece.reserve(BULK_RECORD_PIECE + 4096);
+    for (size_t i = 0; i < load.size(); ++i)
+    {
+        piece.append(load.row(i, line)) += '\n';
+        if (piece.size() >= BULK_RECORD_PIECE)
+        {
+            if (!out(piece))
+                return false;
+            piece.clear();
+        }
+    }
+    return out(piece);
+}
+
+// --- Write-ahead log ---
+// Every committed transaction is appended to <csv>.wal as one record, "T"
+// followed by its mutations one per line, and fdatasync'ed before it is
+// published, so a commit costs O(changes) I/O instead of rewriting the CSV.
+// A bulk load is one "B" record holding its rows, written outside the groups.
+// Commits are grouped: the first committer to find no flush in progress leads
+// one, waits the group-commit window, then writes every record queued by then
+// and syncs them with a single fdatasync; the others just wait for theirs.
+// Each record is [uint32 length][uint32 crc32][payload]; replay stops at the
+// first torn or corrupt record, so a transaction is replayed whole or not at
+// all. A background checkpoint compacts the log:
+//   1. rotate: .wal -> .wal.1, new empty .wal, copy of the table
+//   2. write the copy to <csv>.tmp, fsync, append "C <size> <hash>" to .wal.1
+//   3. rename .tmp over the CSV, then unlink .wal.1
+// On startup .wal.1 (if any) and .wal are replayed over the base. A log that
+// ends with a C record matching the base is already inside it (the crash hit
+// between rename and unlink) and is skipped. If anything was replayed, the
+// server compacts once the same way before accepting clients.
+// `crc` continues a checksum: crc32(b, crc32(a)) is the checksum of a+b
+static uint32_t crc32(const char *data, size_t len, uint32_t crc = 0)
+{
+    static uint32_t table[256];
+    static bool ready = []
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)ready;
+    uint32_t c = crc ^ 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; ++i)
+        c = table[(c ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+static std::string record_header(const std::string &payload)
+{
+    uint32_t header[2] = {static_cast<uint32_t>(payload.size()), crc32(payload.data(), payload.size())};
+    return std::string(reinterpret_cast<const char *>(header), sizeof(header));
+}
+
+static std::string frame_record(const std::string &payload)
+{
+    return record_header(payload) + payload;
+}
+
+// A record's payload, fed to `out` in pieces; false if out() returns false
+using RecordSource = std::function<bool(const std::function<bool(std::string_view)> &out)>;
+
+// Size and checksum of the payload `payload` feeds. Returns false if it does
+// not fit a record.
+static bool record_sum(const RecordSource &payload, uint32_t &size, uint32_t &crc)
+{
+    uint64_t bytes = 0;
+    crc = 0;
+    payload([&](std::string_view piece)
+            {
+                bytes += piece.size();
+                crc = crc32(piece.data(), piece.size(), crc);
+                return bytes <= UINT32_MAX;
+            });
+    size = static_cast<uint32_t>(bytes);
+    return bytes <= UINT32_MAX;
+}
+
+static bool write_all(int fd, std::string_view data)
+{
+    size_t done = 0;
+    while (done < data.size())
+    {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Reads the valid records of a log. valid_bytes is where the last good one ends.
+static std::vector<std::string> read_wal(const std::string &path, off_t &valid_bytes)
+{
+    std::vector<std::string> records;
+    valid_bytes = 0;
+    std::ifstream in(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    size_t pos = 0;
+    while (data.size() - pos >= 8)
+    {
+        uint32_t header[2];
+        memcpy(header, data.data() + pos, sizeof(header));
+        if (header[0] > data.size() - pos - 8 || crc32(data.data() + pos + 8, header[0]) != header[1])
+            break;
+        records.emplace_back(data, pos + 8, header[0]);
+        pos += 8 + header[0];
+    }
+    valid_bytes = static_cast<off_t>(pos);
+    return records;
+}
+
+static void fsync_dir_of(const std::string &path)
+{
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd != -1)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+class WriteAheadLog
+{
+public:
+    // Opens <csv>.wal for appending, after recovery has replayed it
+    bool open_log(const std::string &csv_path)
+    {
+        path_ = csv_path + ".wal";
+        fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd_ == -1)
+        {
+            perror(("open " + path_).c_str());
+            return false;
+        }
+        bytes_ = lseek(fd_, 0, SEEK_END);
+        return true;
+    }
+
+    // How long a flush leader waits for more commits to join it. With 0 a
+    // group only holds the commits that queued while the last flush ran.
+    void set_group_window(std::chrono::microseconds window) { window_ = window; }
+
+    // Logs a transaction's write set durably as one record and then
+    // publishes its pending versions; returns once both are done. A
+    // checkpoint's cut waits for the flush in progress, so it never sees a
+    // logged commit that is not published yet, nor a published one that is
+    // not logged. On failure nothing is published.
+    bool commit(const std::vector<std::string> &write_set, uint64_t owner, std::vector<uint32_t> &written)
+    {
+        if (write_set.empty())
+            return true; // Nothing pending to publish either
+        std::string payload = "T";
+        for (const std::string &mutation : write_set)
+            payload += "\n" + mutation;
+        PendingCommit pending{frame_record(payload), owner, &written};
+        std::unique_lock<std::mutex> lock(mutex_);
+        queue_.push_back(&pending);
+        while (!pending.done)
+        {
+            if (!flushing_)
+                flush_group(lock); // Lead the next group, ours included
+            else
+                flushed_.wait(lock);
+        }
+        return pending.ok;
+    }
+
+    // Logs one large record, a bulk load, outside the commit groups. No group
+    // is flushed meanwhile, so nothing commits between check(), the append
+    // and apply(), which run under write_mutex (taken after the log, as a
+    // flush leader does). The payload is never held whole: `payload` feeds
+    // it in pieces, `size` bytes with checksum `crc` (see record_sum), and a
+    // payload that no longer matches them fails the append. Returns false if
+    // check() refuses or the append fails; apply() runs only once the record
+    // is durable.
+    bool append_exclusive(const RecordSource &payload, uint32_t size, uint32_t crc,
+                          const std::function<bool()> &check, const std::function<void()> &apply)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        flushed_.wait(lock, [this] { return !flushing_; });
+        flushing_ = true;
+        off_t start = bytes_;
+        lock.unlock();
+
+        bool ok;
+        {
+            std::lock_guard<std::mutex> write_lock(g_table.write_mutex);
+            ok = check();
+            if (ok)
+            {
+                uint32_t header[2] = {size, crc}, written = 0;
+                ok = write_all(fd_, std::string_view(reinterpret_cast<const char *>(header), sizeof(header))) &&
+                     payload([&](std::string_view piece)
+                             {
+                                 written = crc32(piece.data(), piece.size(), written);
+                                 return write_all(fd_, piece);
+                             });
+                if (ok && written != crc)
+                {
+                    ok = false;
+                    errno = EIO; // The input changed since record_sum (a file rewritten under LOAD)
+                }
+                ok = ok && fdatasync(fd_) == 0;
+                if (!ok)
+                {
+                    perror(("append " + path_).c_str());
+                    if (ftruncate(fd_, start) != 0)
+                        perror(("truncate " + path_).c_str());
+                }
+                else
+                {
+                    apply();
+                }
+            }
+        }
+
+        lock.lock();
+        if (ok)
+            bytes_ += static_cast<off_t>(8) + size;
+        flushing_ = false;
+        flushed_.notify_all(); // Commits queued meanwhile elect a leader
+        return ok;
+    }
+
+    off_t bytes()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_;
+    }
+
+    // Compacts the log into a new base file (see the comment above)
+    bool checkpoint(const std::string &csv_path)
+    {
+        std::string header;
+        std::unique_ptr<ReadView> view; // Keeps the store of the cut alive
+        std::string old_log = path_ + ".1";
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            flushed_.wait(lock, [this] { return !flushing_; });
+            if (bytes_ == 0)
+                return true;
+            {
+                std::shared_lock<std::shared_mutex> latch(g_table.index_latch);
+                header = g_table.header;
+            }
+            // Nothing commits while the log mutex is held and no flush runs, so the versions
+            // committed at the view's timestamp are exactly what the rotated
+            // log describes; pending ones belong to later records. Those
+            // stay put once the lock is gone, so they are gathered after.
+            view = std::make_unique<ReadView>();
+            close(fd_);
+            fd_ = -1;
+            if (rename(path_.c_str(), old_log.c_str()) == -1)
+            {
+                perror(("rename " + path_).c_str());
+                open_log(csv_path);
+                return false;
+            }
+            fsync_dir_of(path_);
+            if (!open_log(csv_path))
+                return false;
+        }
+        std::vector<uint32_t> versions = committed_versions(*view->rows, view->ts);
+        return install_base(csv_path, header, *view->rows, versions, {old_log});
+    }
+
+    // Writes header+rows as the new base through <csv>.tmp and an atomic
+    // rename. Each log in covered_logs gets a C record first, so recovery
+    // knows the new base already contains it; afterwards they are unlinked.
+    static bool install_base(const std::string &csv_path, const std::string &header, const RowStore &rows,
+                             const std::vector<uint32_t> &versions, const std::vector<std::string> &covered_logs)
+    {
+        std::string tmp = csv_path + ".tmp";
+        Fingerprint fp;
+        if (!write_csv_data(tmp, header.empty() ? DEFAULT_HEADER : header, rows, versions, &fp))
+            return false;
+        std::string trailer = frame_record("C " + std::to_string(fp.size) + " " + std::to_string(fp.hash));
+        for (const std::string &log : covered_logs)
+        {
+            int fd = open(log.c_str(), O_WRONLY | O_APPEND);
+            bool ok = fd != -1 && write_all(fd, trailer) && fdatasync(fd) == 0;
+            if (fd != -1)
+                close(fd);
+            if (!ok)
+            {
+                perror(("checkpoint " + log).c_str());
+                return false;
+            }
+        }
+        if (rename(tmp.c_str(), csv_path.c_str()) == -1)
+        {
+            perror(("rename " + tmp).c_str());
+            return false;
+        }
+        fsync_dir_of(csv_path);
+        for (const std::string &log : covered_logs)
+            unlink(log.c_str());
+        std::cout << "[Checkpoint] " << versions.size() << " records written to " << csv_path << std::endl;
+        return true;
+    }
+
+private:
+    struct PendingCommit
+    {
+        std::string record;
+        uint64_t owner;
+        std::vector<uint32_t> *written;
+        bool done = false;
+        bool ok = false;
+    };
+
+    // Writes and syncs every queued record, then publishes them. Runs with
+    // flushing_ set, which keeps other leaders and rotation out while the
+    // log mutex is released for the wait and the I/O. lock holds mutex_ on
+    // entry and on return.
+    void flush_group(std::unique_lock<std::mutex> &lock)
+    {
+        flushing_ = true;
+        if (window_.count() > 0)
+        {
+            lock.unlock();
+            std::this_thread::sleep_for(window_);
+            lock.lock();
+        }
+        std::vector<PendingCommit *> group;
+        group.swap(queue_);
+        off_t start = bytes_;
+        lock.unlock();
+
+        std::string data;
+        for (const PendingCommit *c : group)
+            data += c->record;
+        bool ok = write_all(fd_, data) && fdatasync(fd_) == 0;
+        if (!ok)
+        {
+            perror(("append " + path_).c_str());
+            // Drop a partial group, or replay would stop at it forever
+            if (ftruncate(fd_, start) != 0)
+                perror(("truncate " + path_).c_str());
+        }
+        else
+        {
+            std::lock_guard<std::mutex> write_lock(g_table.write_mutex);
+            for (PendingCommit *c : group)
+                publish_writes(c->owner, *c->written);
+        }
+
+        lock.lock();
+        if (ok)
+            bytes_ += static_cast<off_t>(data.size());
+        for (PendingCommit *c : group)
+        {
+            c->ok = ok;
+            c->done = true;
+        }
+        flushing_ = false;
+        flushed_.notify_all();
+    }
+
+    std::mutex mutex_; // Guards everything below
+    std::condition_variable flushed_; // A flush finished
+    std::vector<PendingCommit *> queue_; // Commits waiting for the next flush
+    bool flushing_ = false;              // A leader owns fd_ for a flush
+    std::chrono::microseconds window_{0};
+    std::string path_;
+    int fd_ = -1;
+    off_t bytes_ = 0;
+};
+static WriteAheadLog g_wal;
+
+// Replays .wal.1 and .wal over the loaded base and compacts them into a new
+// base if they held anything. Runs before any client is accepted.
+static bool recover_from_wal(const std::string &csv_path)
+{
+    size_t applied = 0;
+    std::vector<std::string> logs;
+    for (const std::string &log : {csv_path + ".wal.1", csv_path + ".wal"})
+    {
+        if (access(log.c_str(), F_OK) != 0)
+            continue;
+        logs.push_back(log);
+        off_t valid;
+        std::vector<std::string> records = read_wal(log, valid);
+        if (!records.empty() && records.back().compare(0, 2, "C ") == 0)
+        {
+            Fingerprint logged, base;
+            std::istringstream iss(records.back().substr(2));
+            iss >> logged.size >> logged.hash;
+            if (fingerprint_file(csv_path, base) && base == logged)
+                continue; // Already inside the base
+        }
+        for (const std::string &r : records)
+        {
+            if (r.compare(0, 2, "B\n") == 0)
+            {
+                BulkLoad load;
+                std::string error = parse_bulk(std::string_view(r).substr(2), load);
+                if (error.empty())
+                    error = check_bulk(load);
+                if (error.empty())
+                {
+                    apply_bulk(load, 0);
+                    applied += load.size();
+                }
+                continue;
+            }
+            if (r.compare(0, 2, "T\n") != 0)
+            {
+                applied += r[0] != 'C' && apply_mutation(r, 0, nullptr); // Single mutation, from older logs
+                continue;
+            }
+            for (size_t pos = 2, end; pos < r.size(); pos = end + 1)
+            {
+                end = std::min(r.find('\n', pos), r.size());
+                applied += apply_mutation(r.substr(pos, end - pos), 0, nullptr);
+            }
+        }
+    }
+    if (applied == 0)
+    {
+        for (const std::string &log : logs)
+            unlink(log.c_str()); // Nothing the base lacks
+        return true;
+    }
+    std::cout << "Recovered " << applied << " logged changes from the write-ahead log" << std::endl;
+    const RowStore &rows = *g_table.rows.load();
+    return WriteAheadLog::install_base(csv_path, g_table.header, rows, committed_versions(rows, g_table.commit_ts.load()), logs);
+}
+
+// --- Row locks ---
+// Transactions lock the IDs they write (strict two-phase locking: locks are
+// held until COMMIT), so transactions on disjoint IDs run side by side.
+// Deadlocks are avoided with wait-die: transactions are numbered at BEGIN, an
+// older one waits for a younger holder, a younger one never waits for an older
+// one and gets an error instead. Waits are bounded by LOCK_WAIT.
+static const std::chrono::seconds LOCK_WAIT(5);
+
+class LockManager
+{
+public:
+    enum class Result
+    {
+        GRANTED,
+        WAIT,   // Queued: wake is called once the lock is granted or the wait ends
+        DIE,    // Held (or granted next) by an older transaction
+        TIMEOUT // Waited LOCK_WAIT without getting it
+    };
+
+    // Takes the lock on key for txn, or queues txn behind the holder. A queued
+    // caller calls acquire again after wake to learn the outcome.
+    Result acquire(int key, uint64_t txn, const std::function<void()> &wake)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto verdict = verdicts_.find(txn);
+        if (verdict != verdicts_.end() && verdict->second.first == key)
+        {
+            Result r = verdict->second.second;
+            verdicts_.erase(verdict);
+            return r;
+        }
+        Entry &e = locks_[key];
+        if (e.holder == 0)
+        {
+            e.holder = txn;
+            held_[txn].push_back(key);
+        }
+        if (e.holder == txn)
+            return Result::GRANTED;
+        if (txn > e.holder)
+            return Result::DIE;
+        if (waiting_.emplace(txn, key).second) // A session waits for one key at a time
+        {
+            e.waiters.push_back({txn, wake, std::chrono::steady_clock::now() + LOCK_WAIT});
+            queued_.notify_one(); // expire_loop may be idle
+        }
+        return Result::WAIT;
+    }
+
+    // Thread mode: waits in place until acquire has an answer
+    Result acquire_blocking(int key, uint64_t txn)
+    {
+        std::mutex m;
+        std::condition_variable cv;
+        bool woken = false;
+        std::function<void()> wake = [&] {
+            std::lock_guard<std::mutex> lock(m);
+            woken = true;
+            cv.notify_one();
+        };
+        Result r = acquire(key, txn, wake);
+        if (r != Result::WAIT)
+            return r;
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [&] { return woken; }); // expire_loop bounds the wait
+        lock.unlock();
+        return acquire(key, txn, wake);
+    }
+
+    // Drops every lock of txn (and any wait it left queued), handing each key
+    // to its oldest waiter.
+    void release_all(uint64_t txn)
+    {
+        std::vector<std::function<void()>> wakes;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto waiting = waiting_.find(txn);
+            if (waiting != waiting_.end())
+            {
+                auto &waiters = locks_[waiting->second].waiters;
+                waiters.erase(std::find_if(waiters.begin(), waiters.end(), [txn](const Waiter &w) { return w.txn == txn; }));
+                waiting_.erase(waiting);
+            }
+            verdicts_.erase(txn);
+            auto held = held_.find(txn);
+            if (held != held_.end())
+            {
+                for (int key : held->second)
+                    grant_next(key, wakes);
+                held_.erase(held);
+            }
+        }
+        for (auto &wake : wakes)
+            wake();
+    }
+
+    // Ends each wait once its deadline passes. Runs on a thread of its own,
+    // asleep until the earliest deadline or a new wait, so no other
+    // background work holds a timeout up.
+    void expire_loop()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            std::vector<std::function<void()>> wakes;
+            auto now = std::chrono::steady_clock::now();
+            auto next = std::chrono::steady_clock::time_point::max();
+            for (auto waiting = waiting_.begin(); waiting != waiting_.end();)
+            {
+                uint64_t txn = waiting->first;
+                auto &waiters = locks_[waiting->second].waiters;
+                auto it = std::find_if(waiters.begin(), waiters.end(), [txn](const Waiter &w) { return w.txn == txn; });
+                if (it->deadline > now)
+                {
+                    next = std::min(next, it->deadline);
+                    ++waiting;
+                    continue;
+                }
+                verdicts_[txn] = {waiting->second, Result::TIMEOUT};
+                wakes.push_back(std::move(it->wake));
+                waiters.erase(it);
+                waiting = waiting_.erase(waiting);
+            }
+            if (!wakes.empty())
+            {
+                lock.unlock();
+                for (auto &wake : wakes)
+                    wake();
+                lock.lock();
+            }
+            else if (next == std::chrono::steady_clock::time_point::max())
+            {
+                queued_.wait(lock);
+            }
+            else
+            {
+                queued_.wait_until(lock, next);
+            }
+        }
+    }
+
+private:
+    struct Waiter
+    {
+        uint64_t txn;
+        std::function<void()> wake;
+        std::chrono::steady_clock::time_point deadline;
+    };
+    struct Entry
+    {
+        uint64_t holder = 0; // 0 = free
+        std::vector<Waiter> waiters;
+    };
+
+    // The oldest waiter becomes the holder. The rest are younger than it and
+    // wait-die does not let them wait for an older transaction, so they fail.
+    // Caller holds mutex_.
+    void grant_next(int key, std::vector<std::function<void()>> &wakes)
+    {
+        auto e = locks_.find(key);
+        auto &waiters = e->second.waiters;
+        if (waiters.empty())
+        {
+            locks_.erase(e);
+            return;
+        }
+        auto oldest = std::min_element(waiters.begin(), waiters.end(),
+                                       [](const Waiter &a, const Waiter &b) { return a.txn < b.txn; });
+        uint64_t holder = oldest->txn;
+        e->second.holder = holder;
+        held_[holder].push_back(key);
+        for (auto &w : waiters)
+        {
+            if (w.txn != holder)
+                verdicts_[w.txn] = {key, Result::DIE};
+            waiting_.erase(w.txn);
+            wakes.push_back(std::move(w.wake));
+        }
+        waiters.clear();
+    }
+
+    std::mutex mutex_;
+    std::condition_variable queued_;                                       // A wait was queued
+    std::unordered_map<int, Entry> locks_;                                 // key -> holder and queue
+    std::unordered_map<uint64_t, std::vector<int>> held_;                  // txn -> keys it holds
+    std::unordered_map<uint64_t, int> waiting_;                            // txn -> key it is queued for
+    std::unordered_map<uint64_t, std::pair<int, Result>> verdicts_;        // txn -> end of a wait not yet seen
+};
+
+static LockManager g_locks;
+static std::atomic<uint64_t> g_next_txn{0};
+
+// Background compaction: every checkpoint_s seconds, or sooner if the log
+// grows past checkpoint_bytes. Each tick also frees the row stores that
+// compaction retired once their last reader is done.
+static void checkpoint_loop(int checkpoint_s, off_t checkpoint_bytes)
+{
+    auto last = std::chrono::steady_clock::now();
+    while (true)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        g_epochs.collect();
+        off_t bytes = g_wal.bytes();
+        bool due = std::chrono::steady_clock::now() - last >= std::chrono::seconds(checkpoint_s);
+        if (bytes > 0 && (due || bytes >= checkpoint_bytes))
+        {
+            g_wal.checkpoint(g_csv_path);
+            last = std::chrono::steady_clock::now();
+        }
+    }
+}
+
+// Drops the `moved` entries no snapshot can need: the slot's newest version
+// is committed, no ReadView is older than it, and it does not hold the old
+// ID (or the index points at the slot again). The scan runs under
+// write_mutex alone, which every change to `moved` takes; readers wait only
+// for the erasing. Under write_mutex commit_ts holds still, so a view taken
+// meanwhile reads at commit_ts or is already pinned with an older timestamp.
+static void prune_moved()
+{
+    std::lock_guard<std::mutex> lock(g_table.write_mutex);
+    if (g_table.moved.empty())
+        return;
+    uint64_t oldest = std::min(g_table.commit_ts.load(), g_epochs.oldest_snapshot());
+    const RowStore &rows = *g_table.rows.load();
+    std::vector<std::unordered_multimap<int, uint32_t>::iterator> unused;
+    for (auto it = g_table.moved.begin(); it != g_table.moved.end(); ++it)
+    {
+        uint64_t begin = rows.newest(it->second);
+        if ((begin & RowStore::PENDING) || begin > oldest)
+            continue;
+        uint32_t v = rows.visible(it->second, RowStore::LATEST);
+        int id;
+        if (v != RowStore::NONE && row_id(rows.text(v), id) && id == it->first && find_row(id) != it->second)
+            continue; // Still the only way to the slot
+        unused.push_back(it);
+    }
+    if (unused.empty())
+        return;
+    std::unique_lock<std::shared_mutex> latch(g_table.index_latch);
+    for (auto it : unused)
+        g_table.moved.erase(it);
+}
+
+// Compacts the row store, rebuilds the postings and prunes `moved` when
+// they are due. A
+// thread of its own, so a long pass delays neither checkpoints nor lock
+// timeouts.
+static void compaction_loop()
+{
+    while (true)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        compact_table();
+        rebuild_secondary();
+        prune_moved();
+    }
+}
+
+// --- Wire protocol ---
+// A request is one line ending in '\n' (a '\r' before it is dropped), so a
+// client may pipeline many requests in one write and a request may arrive
+// split across reads. Each response is sent as chunks "<length>\n<bytes>"
+// closed by an empty chunk "0\n", in the order the requests came in. The
+// admission messages sent before the first request stay plain lines.
+static const size_t MAX_REQUEST_BYTES = size_t(1) << 20;
+
+// Moves the complete requests at the front of `input` to `requests`, skipping
+// empty lines. Returns false once an unfinished line exceeds MAX_REQUEST_BYTES.
+static bool split_requests(std::string &input, std::deque<std::string> &requests)
+{
+    size_t start = 0, nl;
+    while ((nl = input.find('\n', start)) != std::string::npos)
+    {
+        size_t end = nl > start && input[nl - 1] == '\r' ? nl - 1 : nl;
+        if (end > start)
+            requests.emplace_back(input, start, end - start);
+        start = nl + 1;
+    }
+    input.erase(0, start);
+    return input.size() <= MAX_REQUEST_BYTES;
+}
+
+// Responses are written whole, so Nagle's algorithm would only hold the last
+// piece of one back until the client ACKs (which it may delay), stalling a
+// pipelining client for tens of milliseconds per batch
+static void set_nodelay(int fd)
+{
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// Appends `data` to `out` as one chunk of a response
+static void frame_chunk(std::string &out, std::string_view data)
+{
+    if (!data.empty())
+    {
+        out += std::to_string(data.size());
+        out += '\n';
+        out += data;
+    }
+}
+
+// Appends `body` to `out` as one complete response
+static void frame_response(std::string &out, const std::string &body)
+{
+    frame_chunk(out, body);
+    out += "0\n";
+}
+
+// Cursors hold a pinned snapshot each; the pins are a bounded resource
+static const size_t MAX_CURSORS_PER_SESSION = 8;
+static const int MAX_OPEN_CURSORS = 1024;
+static std::atomic<int> g_open_cursors{0};
+
+// --- Client session state, shared by both server modes ---
+struct Session
+{
+    int fd = -1;
+    int id = 0;
+    bool transaction_active = false; // This client's transaction state
+    uint64_t txn = 0;                // Wait-die age of the transaction, from BEGIN
+    std::vector<uint32_t> written;   // slots holding this transaction's pending versions
+    std::vector<std::string> write_set; // its mutations, for the log record at COMMIT
+    std::shared_ptr<QueryCursor> stream; // The response being streamed, if any
+    std::unordered_map<int, std::shared_ptr<QueryCursor>> cursors; // Open cursors, by ID
+    int next_cursor = 0;
+    bool bulk = false;               // Between BULK_ADD and END_BULK
+    std::string bulk_rows;           // The rows sent since BULK_ADD
+    std::function<void()> wake;      // epoll mode: re-runs a request parked on a lock
+    bool blocked = false;            // The last request was parked on a lock
+};
+
+// Ends the session's transaction without applying it
+static void rollback_transaction(Session &session)
+{
+    discard_writes(session.id, session.written, session.write_set);
+    session.write_set.clear();
+    g_locks.release_all(session.txn);
+    session.transaction_active = false;
+}
+
+// Appends the next piece of the session's streamed response to out, framed.
+// Returns false once the response is complete and the stream released.
+static bool stream_piece(Session &session, std::string &out)
+{
+    std::string piece;
+    bool more = session.stream->fill(piece, STREAM_PIECE_BYTES);
+    frame_chunk(out, piece);
+    if (more)
+        return true;
+    out += "0\n";
+    session.stream.reset();
+    return false;
+}
+
+// Releases what a disconnected client left behind.
+static void end_session(Session &session)
+{
+    session.stream.reset();
+    g_open_cursors -= static_cast<int>(session.cursors.size());
+    session.cursors.clear(); // Unpins their snapshots
+    if (session.transaction_active)
+    {
+        rollback_transaction(session); // Nothing of it was logged
+        std::cerr << "[Handler " << session.id << "] WARNING: Client disconnected during an active transaction. Changes rolled back.\n";
+    }
+}
+
+// Adds one mutation to the session's transaction: applied now as pending
+// versions only the session sees, logged at COMMIT.
+static bool stage_mutation(Session &session, std::string payload)
+{
+    std::lock_guard<std::mutex> lock(g_table.write_mutex);
+    if (!apply_mutation(payload, RowStore::PENDING | session.id, &session.written))
+        return false;
+    session.write_set.push_back(std::move(payload));
+    return true;
+}
+
+// Runs a parsed bulk load as its own transaction and returns the response
+static std::string bulk_load(BulkLoad &load)
+{
+    if (load.size() == 0)
+        return "ERROR: No records to load.\n";
+    RecordSource payload = [&](const std::function<bool(std::string_view)> &out) { return bulk_record(load, out); };
+    uint32_t size, crc;
+    if (!record_sum(payload, size, crc))
+        return "ERROR: Too much data for one bulk load.\n";
+    std::string error;
+    auto check = [&]
+    {
+        error = check_bulk(load);
+        return error.empty();
+    };
+    auto apply = [&]
+    {
+        uint64_t ts = g_table.commit_ts.load() + 1;
+        apply_bulk(load, ts);
+        g_table.commit_ts.store(ts); // Every row at once, like a commit
+    };
+    if (!g_wal.append_exclusive(payload, size, crc, check, apply))
+        return error.empty() ? "ERROR: Failed to write to the write-ahead log. Nothing was loaded.\n" : error;
+    return "Bulk load committed: " + std::to_string(load.size()) + " records added.\n";
+}
+
+// Runs a bulk load of `text` (CSV rows, optionally after a header line)
+static std::string bulk_load(std::string_view text)
+{
+    BulkLoad load;
+    std::string error = parse_bulk(text, load);
+    return error.empty() ? bulk_load(load) : error;
+}
+
+// LOAD: a CSV file, mapped and read in place, or a binary snapshot whose rows
+// are formatted one at a time
+static std::string bulk_load_file(const std::string &path)
+{
+    Snapshot snap;
+    switch (snap.open(path))
+    {
+    case Snapshot::BAD:
+        return "ERROR: '" + path + "' is not a valid binary snapshot.\n";
+    case Snapshot::OK:
+    {
+        BulkLoad load;
+        std::string error = parse_bulk(snap, load);
+        return error.empty() ? bulk_load(load) : error;
+    }
+    case Snapshot::NOT_SNAPSHOT:
+        break;
+    }
+    MappedFile file;
+    if (!file.open(path))
+        return "ERROR: Could not read '" + path + "'.\n";
+    return bulk_load(file.text());
+}
+
+// Takes the lock on record ID id for the session's transaction. On false the
+// command must stop: response holds the error, or session.blocked is set when
+// the request waits in the lock queue and session.wake will re-run it.
+static bool lock_row(Session &session, int id, std::string &response)
+{
+    LockManager::Result r = session.wake ? g_locks.acquire(id, session.txn, session.wake)
+                                         : g_locks.acquire_blocking(id, session.txn);
+    switch (r)
+    {
+    case LockManager::Result::GRANTED:
+        return true;
+    case LockManager::Result::WAIT:
+        session.blocked = true;
+        break;
+    case LockManager::Result::DIE:
+        rollback_transaction(session); // Wait-die: the younger transaction aborts
+        response = "ERROR: Record ID " + std::to_string(id) + " is locked by an older transaction. Transaction rolled back.\n";
+        break;
+    case LockManager::Result::TIMEOUT:
+        response = "ERROR: Timed out waiting for the lock on record ID " + std::to_string(id) + ".\n";
+        break;
+    }
+    return false;
+}
+
+// --- Command processing ---
+// Executes one request from a client and returns the response text.
+std::string process_command(Session &session, const std::string &request)
+{
+    if (session.bulk && request != "END_BULK")
+    {
+        // A row for the bulk load: no response until END_BULK
+        if (session.bulk_rows.size() + request.size() >= MAX_BULK_BYTES)
+        {
+            session.bulk = false;
+            std::string().swap(session.bulk_rows);
+            return "ERROR: Too many rows for one BULK_ADD; nothing was loaded. Use LOAD <path> for large files.\n";
+        }
+        session.bulk_rows.append(request).append("\n");
+        return "";
+    }
+
+    std::istringstream iss(request);
+    std::string command;
+    iss >> command;
+
+    std::string response = "OK\n";
+
+    if (command == "QUERY" || command == "OPEN_CURSOR")
+    {
+        std::string search_term;
+        // No transaction required for read-only query
+        std::getline(iss, search_term);                                     // Read the rest of the line
+        search_term.erase(0, search_term.find_first_not_of(" \t\n\r\f\v")); // Trim leading whitespace
+        size_t offset = 0, limit = SIZE_MAX;
+        take_paging(search_term, offset, limit);
+
+        // A snapshot: the query never waits for writers nor sees a
+        // transaction that has not committed (other than this session's own,
+        // for a QUERY; a cursor outlives requests and reads committed rows)
+        std::shared_lock<std::shared_mutex> latch(g_table.index_latch);
+        if (g_table.header.empty())
+        {
+            response = "ERROR: CSV file is empty.\n";
+        }
+        else if (command == "QUERY")
+        {
+            // Streamed by the handler, piece by piece
+            session.stream = std::make_shared<QueryCursor>(search_term, session.transaction_active ? session.id : 0, offset, limit);
+            session.stream->begin_response(SIZE_MAX, "No records found for '" + search_term + "'.\n");
+            response.clear();
+        }
+        else if (session.cursors.size() >= MAX_CURSORS_PER_SESSION)
+        {
+            response = "ERROR: Too many open cursors. Close one with CLOSE_CURSOR <id>.\n";
+        }
+        else if (g_open_cursors.fetch_add(1) >= MAX_OPEN_CURSORS)
+        {
+            g_open_cursors--;
+            response = "ERROR: The server has too many open cursors. Please reattempt later.\n";
+        }
+        else
+        {
+            int cursor_id = ++session.next_cursor;
+            session.cursors[cursor_id] = std::make_shared<QueryCursor>(search_term, 0, offset, limit);
+            response = "Cursor " + std::to_string(cursor_id) + " opened. Use FETCH " + std::to_string(cursor_id) + " <n>.\n";
+        }
+    }
+    else if (command == "FETCH" || command == "CLOSE_CURSOR")
+    {
+        std::string id_str, count_str;
+        iss >> id_str >> count_str;
+        int cursor_id = 0;
+        size_t count = 0;
+        std::from_chars(id_str.data(), id_str.data() + id_str.size(), cursor_id);
+        auto res = std::from_chars(count_str.data(), count_str.data() + count_str.size(), count);
+        auto it = session.cursors.find(cursor_id);
+        if (it == session.cursors.end())
+        {
+            response = "ERROR: No open cursor '" + id_str + "'.\n";
+        }
+        else if (command == "CLOSE_CURSOR")
+        {
+            session.cursors.erase(it);
+            g_open_cursors--;
+            response = "Cursor " + id_str + " closed.\n";
+        }
+        else if (res.ec != std::errc() || res.ptr != count_str.data() + count_str.size() || count == 0)
+        {
+            response = "ERROR: FETCH requires a cursor ID and a positive row count.\n";
+        }
+        else
+        {
+            session.stream = it->second;
+            session.stream->begin_response(count, "Cursor " + id_str + " has no more records.\n");
+            response.clear();
+        }
+    }
+    else if (command == "GET")
+    {
+        // Point lookup through the ID index; like QUERY it needs no transaction
+        std::string id_str;
+        iss >> id_str;
+        int id;
+        auto res = std::from_chars(id_str.data(), id_str.data() + id_str.size(), id);
+        if (id_str.empty())
+        {
+            response = "ERROR: GET command requires an ID.\n";
+        }
+        else if (res.ec == std::errc::result_out_of_range)
+        {
+            response = "ERROR: ID out of range.\n";
+        }
+        else if (res.ec != std::errc() || res.ptr != id_str.data() + id_str.size())
+        {
+            response = "ERROR: Invalid ID format.\n";
+        }
+        else
+        {
+            std::shared_lock<std::shared_mutex> latch(g_table.index_latch);
+            ReadView view(session.transaction_active ? session.id : 0);
+            uint32_t v = lookup(view, id);
+            if (v != RowStore::NONE)
+            {
+                response = g_table.header + "\n" + std::string(view.rows->text(v)) + "\n";
+            }
+            else
+            {
+                response = "ERROR: Record with ID " + id_str + " not found.\n";
+            }
+        }
+    }
+    else if (command == "BEGIN_TRANSACTION")
+    {
+        if (session.transaction_active)
+        {
+            response = "ERROR: A transaction is already active for this client.\n";
+        }
+        else
+        {
+            session.transaction_active = true;
+            session.txn = ++g_next_txn;
+            response = "Transaction started.\n";
+        }
+    }
+    else if (command == "COMMIT_TRANSACTION")
+    {
+        if (!session.transaction_active)
+        {
+            response = "ERROR: No active transaction to commit.\n";
+        }
+        else if (g_wal.commit(session.write_set, session.id, session.written)) // Visible to every reader from here on
+        {
+            session.write_set.clear();
+            g_locks.release_all(session.txn); // Release the row locks
+            session.transaction_active = false;
+            response = "Transaction committed.\n";
+        }
+        else
+        {
+            rollback_transaction(session);
+            response = "ERROR: Failed to write to the write-ahead log. Transaction rolled back.\n";
+        }
+    }
+    else if (command == "ROLLBACK_TRANSACTION" || command == "ROLLBACK")
+    {
+        if (session.transaction_active)
+        {
+            size_t changes = session.write_set.size();
+            rollback_transaction(session);
+            response = "Transaction rolled back. " + std::to_string(changes) + " changes discarded.\n";
+        }
+        else
+        {
+            response = "ERROR: No active transaction to roll back.\n";
+        }
+    }
+    else if (command == "LOAD" || command == "BULK_ADD" || command == "END_BULK")
+    {
+        std::string path;
+        std::getline(iss, path);
+        path.erase(0, path.find_first_not_of(" \t\n\r\f\v"));
+        std::string text;
+        if (session.transaction_active)
+        {
+            response = "ERROR: A bulk load runs as its own transaction. Commit or roll back the current one first.\n";
+        }
+        else if (command == "BULK_ADD")
+        {
+            session.bulk = true;
+            response = "Bulk load started. Send one record per line, then END_BULK.\n";
+        }
+        else if (command == "END_BULK")
+        {
+            if (session.bulk)
+            {
+                session.bulk = false;
+                text.swap(session.bulk_rows);
+                response = bulk_load(text);
+            }
+            else
+            {
+                response = "ERROR: No bulk load in progress. Start one with BULK_ADD.\n";
+            }
+        }
+        else if (path.empty())
+        {
+            response = "ERROR: LOAD requires the path of a CSV file on the server.\n";
+        }
+        else
+        {
+            response = bulk_load_file(path);
+        }
+    }
+    else if (command == "ADD")
+    {
+        if (!session.transaction_active)
+        {
+            response = "ERROR: ADD requires an active transaction.\n";
+        }
+        else
+        {
+            std::string new_record_data;
+            std::getline(iss, new_record_data);                                         // Read the rest of the line
+            new_record_data.erase(0, new_record_data.find_first_not_of(" \t\n\r\f\v")); // Trim leading whitespace
+
+            bool duplicate = false;
+            int new_id;
+            if (!new_record_data.empty() && row_id(new_record_data, new_id) && !lock_row(session, new_id, response))
+            {
+                return response; // Lock refused or queued
+            }
+            if (!new_record_data.empty())
+            {
+                std::shared_lock<std::shared_mutex> latch(g_table.index_latch);
+                duplicate = id_taken(ReadView(session.id), new_record_data);
+            }
+            if (duplicate)
+            {
+                response = "ERROR: A record with that ID already exists.\n";
+            }
+            else if (!new_record_data.empty())
+            {
+                if (stage_mutation(session, "A " + new_record_data)) // Append the new record
+                {
+                    response = "Record added: " + new_record_data + "\n";
+                }
+                else
+                {
+                    response = "ERROR: Could not apply the change.\n";
+                }
+            }
+            else
+            {
+                response = "ERROR: ADD command requires record data.\n";
+            }
+        }
+    }
+    else if (command == "MODIFY")
+    {
+        if (!session.transaction_active)
+        {
+            response = "ERROR: MODIFY requires an active transaction.\n";
+        }
+        else
+        {
+            std::string id_str, new_record_data_line;
+            iss >> id_str;                                                                        // Read ID
+            std::getline(iss, new_record_data_line);                                              // Read the rest as new record data
+            new_record_data_line.erase(0, new_record_data_line.find_first_not_of(" \t\n\r\f\v")); // Trim leading whitespace
+
+            if (!id_str.empty() && !new_record_data_line.empty())
+            {
+                try
+                {
+                    int id_to_modify = std::stoi(id_str);
+                    int new_id;
+                    if (!lock_row(session, id_to_modify, response) ||
+                        (row_id(new_record_data_line, new_id) && new_id != id_to_modify && !lock_row(session, new_id, response)))
+                    {
+                        return response; // Lock refused or queued
+                    }
+                    bool found, duplicate = false;
+                    {
+                        // The row lock keeps the row as this view sees it until the commit
+                        std::shared_lock<std::shared_mutex> latch(g_table.index_latch);
+                        ReadView view(session.id);
+                        uint32_t slot;
+                        long i = lookup(view, id_to_modify, &slot) == RowStore::NONE ? -1 : static_cast<long>(slot);
+                        found = i >= 0;
+                        duplicate = found && id_taken(view, new_record_data_line, i);
+                    }
+                    if (duplicate)
+                    {
+                        response = "ERROR: A record with that ID already exists.\n";
+                    }
+                    else if (found)
+                    {
+                        // Replace the entire line
+                        if (stage_mutation(session, "M " + std::to_string(id_to_modify) + " " + new_record_data_line))
+                        {
+                            response = "Record ID " + id_str + " modified to: " + new_record_data_line + "\n";
+                        }
+                        else
+                        {
+                            response = "ERROR: Could not apply the change.\n";
+                        }
+                    }
+                    else
+                    {
+                        response = "ERROR: Record with ID " + id_str + " not found.\n";
+                    }
+                }
+                catch (const std::invalid_argument &e)
+                {
+                    response = "ERROR: Invalid ID format.\n";
+                }
+                catch (const std::out_of_range &e)
+                {
+                    response = "ERROR: ID out of range.\n";
+                }
+            }
+            else
+            {
+                response = "ERROR: MODIFY command requires an ID and new record data.\n";
+            }
+        }
+    }
+    else if (command == "DELETE")
+    {
+        if (!session.transaction_active)
+        {
+            response = "ERROR: DELETE requires an active transaction.\n";
+        }
+        else
+        {
+            std::string id_str;
+            iss >> id_str;
+            if (!id_str.empty())
+            {
+                try
+                {
+                    int id_to_delete = std::stoi(id_str);
+                    if (!lock_row(session, id_to_delete, response))
+                    {
+                        return response; // Lock refused or queued
+                    }
+                    bool found;
+                    {
+                        std::shared_lock<std::shared_mutex> latch(g_table.index_latch);
+                        found = lookup(ReadView(session.id), id_to_delete) != RowStore::NONE;
+                    }
+                    if (found)
+                    {
+                        if (stage_mutation(session, "D " + std::to_string(id_to_delete)))
+                        {
+                            response = "Record ID " + id_str + " deleted.\n";
+                        }
+                        else
+                        {
+                            response = "ERROR: Could not apply the change.\n";
+                        }
+                    }
+                    else
+                    {
+                        response = "ERROR: Record with ID " + id_str + " not found.\n";
+                    }
+                }
+                catch (const std::invalid_argument &e)
+                {
+                    response = "ERROR: Invalid ID format.\n";
+                }
+                catch (const std::out_of_range &e)
+                {
+                    response = "ERROR: ID out of range.\n";
+                }
+            }
+            else
+            {
+                response = "ERROR: DELETE command requires an ID.\n";
+            }
+        }
+    }
+    else
+    {
+        response = "ERROR: Unknown command '" + command + "'.\nAvailable commands: QUERY <term> [LIMIT n] [OFFSET m], QUERY <col>=<value> [AND ...], OPEN_CURSOR <term>, FETCH <cursor> <n>, CLOSE_CURSOR <cursor>, GET <id>, BEGIN_TRANSACTION, COMMIT_TRANSACTION, ROLLBACK_TRANSACTION, ADD <data>, MODIFY <id> <data>, DELETE <id>, LOAD <path>, BULK_ADD ... END_BULK, EXIT.\n";
+    }
+    return response;
+}
+
+// --- Client Request Handler (thread mode) ---
+// Runs on its own thread for each client and returns when the client disconnects.
+void handle_client(int client_sock_fd, int handler_id)
+{
+    char buffer[65536];
+    ssize_t valread;
+    Session session;
+    session.fd = client_sock_fd;
+    session.id = handler_id;
+    std::string input, output;        // Unfinished request line; responses not sent yet
+    std::deque<std::string> requests; // Complete requests of the last read
+
+    std::cout << "[Handler " << handler_id << "] Handling new client." << std::endl;
+    set_nodelay(client_sock_fd);
+
+    while ((valread = read(client_sock_fd, buffer, sizeof(buffer))) > 0)
+    {
+        input.append(buffer, static_cast<size_t>(valread));
+        bool ok = split_requests(input, requests);
+        bool sent = true;
+        for (; sent && !requests.empty(); requests.pop_front())
+        {
+            std::string response = process_command(session, requests.front());
+            if (!session.stream)
+            {
+                frame_response(output, response);
+                continue;
+            }
+            // A streamed response goes out as it is produced; the blocking
+            // write holds the query back while the client is slow to read
+            while (sent && stream_piece(session, output))
+            {
+                if (output.size() >= STREAM_PIECE_BYTES)
+                {
+                    sent = write_all(client_sock_fd, output);
+                    output.clear();
+                }
+            }
+        }
+        // Everything pipelined in one read is answered with one write
+        if (!sent || !write_all(client_sock_fd, output))
+            break;
+        output.clear();
+        if (!ok)
+        {
+            std::cerr << "[Handler " << handler_id << "] Request longer than " << MAX_REQUEST_BYTES << " bytes. Disconnecting client." << std::endl;
+            break;
+        }
+    }
+
+    // Client disconnected or read error
+    end_session(session);
+    close(client_sock_fd);
+    std::cout << "[Handler " << handler_id << "] Client disconnected. Handler thread exiting." << std::endl;
+}
+
+// --- Admission (thread mode) ---
+// Acceptor threads and exiting handlers share the N/M admission state.
+static std::mutex g_admission_mutex; // Guards waiting_client_sockets and the N check
+
+static void promote_waiting_clients();
+
+// Starts a detached handler thread for an accepted client. When the thread
+// finishes it frees its slot and hands it straight to the next waiting client,
+// so promotion never waits for the acceptor. Caller holds g_admission_mutex.
+static bool start_handler(int client_sock_fd)
+{
+    int handler_id = ++next_handler_id;
+    active_client_handlers++;
+    try
+    {
+        std::thread([client_sock_fd, handler_id]
+                    {
+                        handle_client(client_sock_fd, handler_id);
+                        std::lock_guard<std::mutex> lock(g_admission_mutex);
+                        active_client_handlers--;
+                        promote_waiting_clients();
+                    })
+            .detach();
+    }
+    catch (const std::system_error &e)
+    {
+        active_client_handlers--;
+        std::cerr << "[Server] Could not start handler thread: " << e.what() << std::endl;
+        return false;
+    }
+    std::cout << "[Server] Started handler " << handler_id << ". Active handlers: " << active_client_handlers << std::endl;
+    return true;
+}
+
+// Procesa la cola de clientes en espera mientras haya slots disponibles (N no alcanzado).
+// Caller holds g_admission_mutex.
+static void promote_waiting_clients()
+{
+    while (!waiting_client_sockets.empty() && active_client_handlers < max_allowed_concurrent_clients)
+    {
+        int client_sock_from_queue = waiting_client_sockets.front();
+        waiting_client_sockets.pop();
+
+        std::cout << "[Server] Dequeuing client from waiting list. Queue size: " << waiting_client_sockets.size() << std::endl;
+
+        // Enviar un mensaje de "es tu turno" antes de lanzar el manejador
+        std::string turn_msg = "SERVER: Your turn! Processing your request now.\n";
+        send(client_sock_from_queue, turn_msg.c_str(), turn_msg.length(), 0);
+
+        if (!start_handler(client_sock_from_queue))
+        {
+            std::string err_msg = "ERROR: Server could not start a handler for queued client.\n";
+            send(client_sock_from_queue, err_msg.c_str(), err_msg.length(), 0);
+            close(client_sock_from_queue);
+        }
+    }
+}
+
+// Decide qué hacer con un cliente recién aceptado: atenderlo, encolarlo o rechazarlo.
+static void admit_client(int new_socket, const sockaddr_in &address)
+{
+    std::lock_guard<std::mutex> lock(g_admission_mutex);
+    if (active_client_handlers < max_allowed_concurrent_clients)
+    {
+        // N clientes concurrentes NO alcanzado: asignar un hilo manejador inmediatamente
+        // Enviar un mensaje de "listo" antes de lanzarlo, para que el cliente sepa que será atendido.
+        std::string ready_msg = "SERVER: Connected and ready to process commands.\n";
+        send(new_socket, ready_msg.c_str(), ready_msg.length(), 0);
+
+        if (!start_handler(new_socket))
+        {
+            std::string err_msg = "ERROR: Server could not start a handler for this client.\n";
+            send(new_socket, err_msg.c_str(), err_msg.length(), 0);
+            close(new_socket);
+        }
+    }
+    else if (waiting_client_sockets.size() < static_cast<size_t>(max_app_waiting_clients_queue))
+    {
+        // N clientes concurrentes YA alcanzado, pero la cola de la aplicación NO está llena.
+        // Enviar mensaje de espera y encolar el socket.
+        std::string wait_msg = "SERVER: Max concurrent clients reached. You are in waiting queue. Please wait...\n";
+        send(new_socket, wait_msg.c_str(), wait_msg.length(), 0);
+        waiting_client_sockets.push(new_socket);
+        std::cout << "[Server] Client " << inet_ntoa(address.sin_addr) << ":" << ntohs(address.sin_port) << " enqueued. Waiting queue size: " << waiting_client_sockets.size() << std::endl;
+    }
+    else
+    {
+        // N clientes concurrentes YA alcanzado Y la cola de la aplicación TAMBIÉN está llena.
+        // Rechazar la conexión explícitamente.
+        std::string refused_msg = "SERVER: Connection refused. Server's active client limit reached and waiting queue is full. Please try again later.\n";
+        send(new_socket, refused_msg.c_str(), refused_msg.length(), 0);
+        std::cout << "[Server] Client " << inet_ntoa(address.sin_addr) << ":" << ntohs(address.sin_port) << " refused (queue full).\n";
+        close(new_socket); // Es crucial cerrar el socket aquí.
+    }
+}
+
+// Acceptor: duerme en poll() hasta que el socket de escucha tiene conexiones
+// y entonces las acepta todas (hasta EAGAIN), en vez de una por cada tick.
+static void acceptor_loop(int server_fd)
+{
+    pollfd pfd{};
+    pfd.fd = server_fd;
+    pfd.events = POLLIN;
+    while (true)
+    {
+        if (poll(&pfd, 1, -1) == -1)
+        {
+            if (errno != EINTR)
+                perror("poll");
+            continue;
+        }
+        while (true)
+        {
+            sockaddr_in address{};
+            socklen_t addrlen = sizeof(address);
+            int new_socket = accept(server_fd, (struct sockaddr *)&address, &addrlen);
+            if (new_socket == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    perror("accept"); // Un error real, no "no hay conexiones pendientes"
+                break;
+            }
+            std::cout << "[Server] New client accepted from " << inet_ntoa(address.sin_addr) << ":" << ntohs(address.sin_port) << std::endl;
+            admit_client(new_socket, address);
+        }
+    }
+}
+
+// Crea un socket de escucha no bloqueante en el puerto. Con SO_REUSEPORT
+// varios sockets pueden compartir el puerto y el kernel reparte las conexiones.
+static int open_listen_socket(int port, int backlog)
+{
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd == -1)
+    {
+        perror("socket failed");
+        return -1;
+    }
+
+    // Forcefully attach socket to the port (prevents "Address already in use" after crash)
+    int opt = 1;
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)))
+    {
+        perror("setsockopt");
+        close(server_fd);
+        return -1;
+    }
+    struct sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY; // Listen on all available network interfaces
+    address.sin_port = htons(port);
+
+    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        perror("bind failed");
+        close(server_fd);
+        return -1;
+    }
+    if (listen(server_fd, backlog) < 0)
+    {
+        perror("listen");
+        close(server_fd);
+        return -1;
+    }
+    // No bloqueante: cada acceptor drena la cola de accept() hasta EAGAIN
+    if (fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL, 0) | O_NONBLOCK) == -1)
+    {
+        perror("fcntl F_SETFL O_NONBLOCK");
+        close(server_fd);
+        return -1;
+    }
+    return server_fd;
+}
+
+// --- Work-stealing worker pool (epoll mode) ---
+// Each worker owns a deque. Tasks submitted by the reactor are spread
+// round-robin; a task submitted from a worker goes to that worker's own deque.
+// A worker runs tasks from the front of its deque and, when it runs dry,
+// steals from the back of the others before going to sleep.
+class WorkerPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkerPool(int workers)
+    {
+        for (int i = 0; i < workers; ++i)
+            queues_.emplace_back(new Queue);
+        for (int i = 0; i < workers; ++i)
+            threads_.emplace_back([this, i] { run(i); });
+    }
+
+    void submit(Task task)
+    {
+        size_t target = current_worker_ >= 0 ? static_cast<size_t>(current_worker_) : next_++ % queues_.size();
+        {
+            std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+            queues_[target]->tasks.push_back(std::move(task));
+        }
+        pending_++;
+        std::lock_guard<std::mutex> lock(idle_mutex_); // Pairs with the wait in run(): no lost wakeups
+        idle_cv_.notify_one();
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool take(size_t self, Task &task)
+    {
+        {
+            Queue &own = *queues_[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty())
+            {
+                task = std::move(own.tasks.front());
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues_.size(); ++k)
+        {
+            Queue &victim = *queues_[(self + k) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(size_t self)
     {
-        for (const std::string &line : data)
+        current_worker_ = static_cast<int>(self);
+        while (true)
         {
-            file << line << "\n";
+            Task task;
+            if (take(self, task))
+            {
+                pending_--;
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(idle_mutex_);
+            idle_cv_.wait(lock, [this] { return pending_.load() > 0; });
         }
-        file.close();
-        return true;
-    }
-    else
-    {
-        std::cerr << "Error: Could not open CSV file for writing: " << path << std::endl;
-        return false;
     }
-}
 
-// --- Client Request Handler ---
-void handle_client(int client_sock_fd, pid_t client_handler_pid)
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> next_{0};
+    std::atomic<long> pending_{0}; // submitted but not yet taken
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+    static thread_local int current_worker_; // index of the calling worker, -1 outside the pool
+};
+thread_local int WorkerPool::current_worker_ = -1;
+
+// --- epoll mode ---
+// One reactor thread owns the listening socket and every connection: it
+// accepts, reads requests and flushes output the socket could not take. Each
+// request is queued on its connection and executed by the worker pool, with at
+// most one task in flight per connection so a client's commands run in order.
+// An idle connection costs a few hundred bytes instead of a thread.
+#define OUTBOX_PAUSE_BYTES (4 * 1024 * 1024) // Stop reading a client that doesn't read its responses
+#define OUTBOX_STREAM_BYTES (1024 * 1024)    // Stop producing a streamed response until the client catches up
+
+struct Connection
 {
-    char buffer[4096] = {0}; // Increased buffer size for larger responses/requests
-    int valread;
-    bool transaction_active = false; // Flag for this specific client's transaction state
+    Session session;
+    std::string input;             // Unfinished request line; only the reactor touches it
+    std::mutex mutex;              // Guards everything below
+    std::deque<std::string> inbox; // Requests waiting for a worker
+    bool busy = false;             // A pool task is running this connection
+    std::string outbox;            // Response bytes not sent yet
+    uint32_t events = 0;           // Current epoll interest
+    bool closed = false;           // Reactor removed it from epoll
+    bool parked = false;           // Front request waits for a row lock, no task runs
+    bool woken = false;            // The lock wait ended before the request was parked
+    bool stalled = false;          // A streamed response waits for the outbox to drain
 
-    // Each child process must open its own file descriptor to the CSV for `flock` to work correctly.
-    int local_csv_fd = open(g_csv_path.c_str(), O_RDWR); // Open for read/write
-    if (local_csv_fd == -1)
+    ~Connection()
     {
-        std::cerr << "[Handler PID " << getpid() << "] Error: Could not open CSV file for locking: " << g_csv_path << " - " << strerror(errno) << std::endl;
-        std::string err_msg = "ERROR: Server internal error opening CSV file.\n";
-        send(client_sock_fd, err_msg.c_str(), err_msg.length(), 0);
-        close(client_sock_fd);
-        _exit(1); // Child process exits
+        end_session(session);
+        close(session.fd);
     }
+};
 
-    std::cout << "[Handler PID " << getpid() << "] Handling new client." << std::endl;
+class EpollServer
+{
+public:
+    EpollServer(const std::vector<int> &listen_fds, int workers) : listen_fds_(listen_fds), pool_(workers) {}
 
-    while ((valread = read(client_sock_fd, buffer, sizeof(buffer) - 1)) > 0)
+    int run()
     {
-        buffer[valread] = '\0'; // Null-terminate the received data
-        std::string request(buffer);
-        std::istringstream iss(request);
-        std::string command;
-        iss >> command;
-
-        std::string response = "OK\n";
-
-        if (command == "QUERY")
+        epfd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd_ == -1)
         {
-            std::string search_term;
-            // No transaction required for read-only query
-            std::getline(iss, search_term);                                     // Read the rest of the line
-            search_term.erase(0, search_term.find_first_not_of(" \t\n\r\f\v")); // Trim leading whitespace
-
-            std::vector<std::string> records = read_csv_data(g_csv_path);
-            std::string result = "";
-            bool first_line = true;
-            for (const auto &record : records)
+            perror("epoll_create1");
+            return 1;
+        }
+        for (int fd : listen_fds_)
+        {
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) == -1)
             {
-                if (first_line)
-                {
-                    result += record + "\n"; // Include header in query response
-                    first_line = false;
-                    continue;
-                }
-                if (record.find(search_term) != std::string::npos)
-                {
-                    result += record + "\n";
-                }
+                perror("epoll_ctl listen");
+                return 1;
             }
-            // Condición para respuesta de "No records found" si solo se incluye el encabezado
-            if (records.empty())
+        }
+
+        epoll_event events[256];
+        while (true)
+        {
+            int n = epoll_wait(epfd_, events, 256, -1);
+            if (n == -1)
             {
-                response = "ERROR: CSV file is empty.\n";
-            }
-            else if (result.length() <= records[0].length() + 1)
-            { // +1 for newline, if records[0] is just the header
-                response = "No records found for '" + search_term + "'.\n";
+                if (errno == EINTR)
+                    continue;
+                perror("epoll_wait");
+                return 1;
             }
-            else
+            for (int i = 0; i < n; ++i)
             {
-                response = result;
+                int fd = events[i].data.fd;
+                if (std::find(listen_fds_.begin(), listen_fds_.end(), fd) != listen_fds_.end())
+                {
+                    accept_clients(fd);
+                    continue;
+                }
+                auto it = connections_.find(fd);
+                if (it == connections_.end())
+                    continue;
+                std::shared_ptr<Connection> conn = it->second;
+                if (events[i].events & EPOLLOUT)
+                    flush(conn);
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    read_request(conn);
             }
         }
-        else if (command == "BEGIN_TRANSACTION")
+    }
+
+private:
+    static constexpr int RUN_BATCH = 64; // requests one pool task runs for a connection
+
+    // Accepts everything pending on a listening socket (it is non-blocking)
+    void accept_clients(int listen_fd)
+    {
+        while (true)
         {
-            if (transaction_active)
+            sockaddr_in address{};
+            socklen_t addrlen = sizeof(address);
+            int fd = accept(listen_fd, (struct sockaddr *)&address, &addrlen);
+            if (fd == -1)
             {
-                response = "ERROR: A transaction is already active for this client.\n";
-            }
-            else if (flock(local_csv_fd, LOCK_EX | LOCK_NB) == -1)
-            { // Attempt exclusive lock
-                if (errno == EWOULDBLOCK)
-                {
-                    response = "ERROR: Another transaction is active. Please reattempt later.\n";
-                }
-                else
-                {
-                    perror(("[Handler PID " + std::to_string(getpid()) + "] flock LOCK_EX (BEGIN_TRANSACTION)").c_str());
-                    response = "ERROR: Could not acquire file lock: " + std::string(strerror(errno)) + "\n";
-                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    perror("accept");
+                return;
             }
-            else
+            std::cout << "[Server] New client accepted from " << inet_ntoa(address.sin_addr) << ":" << ntohs(address.sin_port) << std::endl;
+
+            if (active_client_handlers < max_allowed_concurrent_clients)
             {
-                transaction_active = true;
-                response = "Transaction started. File locked.\n";
+                std::string ready_msg = "SERVER: Connected and ready to process commands.\n";
+                send(fd, ready_msg.c_str(), ready_msg.length(), MSG_NOSIGNAL);
+                add_connection(fd);
             }
-        }
-        else if (command == "COMMIT_TRANSACTION")
-        {
-            if (transaction_active)
+            else if (waiting_client_sockets.size() < static_cast<size_t>(max_app_waiting_clients_queue))
             {
-                flock(local_csv_fd, LOCK_UN); // Release the lock
-                transaction_active = false;
-                response = "Transaction committed. File unlocked.\n";
+                std::string wait_msg = "SERVER: Max concurrent clients reached. You are in waiting queue. Please wait...\n";
+                send(fd, wait_msg.c_str(), wait_msg.length(), MSG_NOSIGNAL);
+                waiting_client_sockets.push(fd);
+                std::cout << "[Server] Client enqueued. Waiting queue size: " << waiting_client_sockets.size() << std::endl;
             }
             else
             {
-                response = "ERROR: No active transaction to commit.\n";
+                std::string refused_msg = "SERVER: Connection refused. Server's active client limit reached and waiting queue is full. Please try again later.\n";
+                send(fd, refused_msg.c_str(), refused_msg.length(), MSG_NOSIGNAL);
+                std::cout << "[Server] Client refused (queue full).\n";
+                close(fd);
             }
         }
-        else if (command == "ADD")
+    }
+
+    void add_connection(int fd)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        set_nodelay(fd);
+        auto conn = std::make_shared<Connection>();
+        conn->session.fd = fd;
+        conn->session.id = ++next_handler_id;
+        std::weak_ptr<Connection> weak = conn;
+        conn->session.wake = [this, weak] {
+            if (auto c = weak.lock())
+                resume(c);
+        };
+        conn->events = EPOLLIN;
+        epoll_event ev{};
+        ev.events = conn->events;
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) == -1)
+        {
+            perror("epoll_ctl add client");
+            return; // conn's destructor closes fd
+        }
+        connections_[fd] = conn;
+        active_client_handlers++;
+        std::cout << "[Server] Client " << conn->session.id << " registered. Active clients: " << active_client_handlers << std::endl;
+    }
+
+    // Moves waiting clients in while there are free slots
+    void promote_waiting()
+    {
+        while (!waiting_client_sockets.empty() && active_client_handlers < max_allowed_concurrent_clients)
+        {
+            int fd = waiting_client_sockets.front();
+            waiting_client_sockets.pop();
+            std::cout << "[Server] Dequeuing client from waiting list. Queue size: " << waiting_client_sockets.size() << std::endl;
+            std::string turn_msg = "SERVER: Your turn! Processing your request now.\n";
+            send(fd, turn_msg.c_str(), turn_msg.length(), MSG_NOSIGNAL);
+            add_connection(fd);
+        }
+    }
+
+    // Whatever arrived is split into requests; see the wire protocol
+    void read_request(const std::shared_ptr<Connection> &conn)
+    {
+        char buffer[65536];
+        ssize_t n = read(conn->session.fd, buffer, sizeof(buffer));
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return;
+        if (n <= 0)
+        {
+            drop(conn);
+            return;
+        }
+        conn->input.append(buffer, static_cast<size_t>(n));
         {
-            if (!transaction_active)
+            std::lock_guard<std::mutex> lock(conn->mutex);
+            bool ok = split_requests(conn->input, conn->inbox);
+            if (ok && !conn->busy && !conn->inbox.empty())
             {
-                response = "ERROR: ADD requires an active transaction.\n";
+                conn->busy = true;
+                pool_.submit([this, conn] { run_next(conn); });
             }
-            else
-            {
-                std::string new_record_data;
-                std::getline(iss, new_record_data);                                         // Read the rest of the line
-                new_record_data.erase(0, new_record_data.find_first_not_of(" \t\n\r\f\v")); // Trim leading whitespace
+            if (ok)
+                return;
+        }
+        std::cerr << "[Server] Client " << conn->session.id << " sent a request longer than " << MAX_REQUEST_BYTES << " bytes. Disconnecting." << std::endl;
+        drop(conn);
+    }
 
-                if (!new_record_data.empty())
-                {
-                    std::vector<std::string> records = read_csv_data(g_csv_path);
-                    if (records.empty())
-                    {                                                      // If file was empty, just add header and record
-                        records.push_back("ID,Nombre,Edad,Ciudad,Fuente"); // Default header
-                    }
-                    records.push_back(new_record_data); // Append the new record
+    // Client gone: stop watching it. Requests already read still run (their
+    // writes apply); the socket closes when the last task lets go of it.
+    void drop(const std::shared_ptr<Connection> &conn)
+    {
+        {
+            std::lock_guard<std::mutex> lock(conn->mutex);
+            conn->closed = true;
+        }
+        epoll_ctl(epfd_, EPOLL_CTL_DEL, conn->session.fd, nullptr);
+        connections_.erase(conn->session.fd);
+        active_client_handlers--;
+        std::cout << "[Server] Client " << conn->session.id << " disconnected. Active clients: " << active_client_handlers << std::endl;
+        promote_waiting();
+    }
 
-                    if (write_csv_data(g_csv_path, records))
-                    {
-                        response = "Record added: " + new_record_data + "\n";
-                    }
-                    else
-                    {
-                        response = "ERROR: Failed to write to CSV file.\n";
-                    }
-                }
-                else
+    // Worker side: executes the queued requests of the connection and sends
+    // their responses together. A task runs at most RUN_BATCH of them, so a
+    // pipelining client does not keep a worker from the others for long.
+    void run_next(const std::shared_ptr<Connection> &conn)
+    {
+        std::string responses;
+        for (int n = 0; n < RUN_BATCH; ++n)
+        {
+            if (conn->session.stream)
+            {
+                // One piece per step; stop producing while the client lags
+                stream_piece(conn->session, responses);
+                if (responses.size() < STREAM_PIECE_BYTES)
+                    continue;
+                std::lock_guard<std::mutex> lock(conn->mutex);
+                conn->outbox += responses;
+                responses.clear();
+                send_pending(*conn);
+                if (conn->closed)
+                    conn->session.stream.reset(); // Nobody left to read it
+                else if (conn->outbox.size() >= OUTBOX_STREAM_BYTES)
                 {
-                    response = "ERROR: ADD command requires record data.\n";
+                    conn->stalled = true; // flush() resumes it
+                    return;
                 }
+                continue;
             }
-        }
-        else if (command == "MODIFY")
-        {
-            if (!transaction_active)
+            std::string request;
             {
-                response = "ERROR: MODIFY requires an active transaction.\n";
+                std::lock_guard<std::mutex> lock(conn->mutex);
+                if (conn->inbox.empty())
+                    break;
+                request = std::move(conn->inbox.front());
+                conn->inbox.pop_front();
             }
-            else
+            std::string response = process_command(conn->session, request);
+            if (conn->session.stream)
+                continue; // Produced by the steps that follow
+            if (!conn->session.blocked)
             {
-                std::string id_str, new_record_data_line;
-                iss >> id_str;                                                                        // Read ID
-                std::getline(iss, new_record_data_line);                                              // Read the rest as new record data
-                new_record_data_line.erase(0, new_record_data_line.find_first_not_of(" \t\n\r\f\v")); // Trim leading whitespace
-
-                if (!id_str.empty() && !new_record_data_line.empty())
-                {
-                    try
-                    {
-                        int id_to_modify = std::stoi(id_str);
-                        std::vector<std::string> records = read_csv_data(g_csv_path);
-                        bool found = false;
-                        for (size_t i = 1; i < records.size(); ++i)
-                        { // Start from 1 to skip header
-                            std::istringstream record_iss(records[i]);
-                            std::string current_id_field;
-                            std::getline(record_iss, current_id_field, ',');
-                            if (std::stoi(current_id_field) == id_to_modify)
-                            {
-                                records[i] = new_record_data_line; // Replace the entire line
-                                found = true;
-                                break;
-                            }
-                        }
-                        if (found)
-                        {
-                            if (write_csv_data(g_csv_path, records))
-                            {
-                                response = "Record ID " + id_str + " modified to: " + new_record_data_line + "\n";
-                            }
-                            else
-                            {
-                                response = "ERROR: Failed to write to CSV file.\n";
-                            }
-                        }
-                        else
-                        {
-                            response = "ERROR: Record with ID " + id_str + " not found.\n";
-                        }
-                    }
-                    catch (const std::invalid_argument &e)
-                    {
-                        response = "ERROR: Invalid ID format.\n";
-                    }
-                    catch (const std::out_of_range &e)
-                    {
-                        response = "ERROR: ID out of range.\n";
-                    }
-                }
-                else
-                {
-                    response = "ERROR: MODIFY command requires an ID and new record data.\n";
-                }
+                frame_response(responses, response);
+                continue;
             }
-        }
-        else if (command == "DELETE")
-        {
-            if (!transaction_active)
+            // Waiting for a row lock: put the request back and free the
+            // worker; resume() runs it again when the wait ends
+            std::lock_guard<std::mutex> lock(conn->mutex);
+            conn->session.blocked = false;
+            conn->inbox.push_front(std::move(request));
+            conn->outbox += responses;
+            send_pending(*conn);
+            if (!conn->woken)
             {
-                response = "ERROR: DELETE requires an active transaction.\n";
+                conn->parked = true;
+                return;
             }
-            else
+            conn->woken = false;
+            responses.clear();
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(conn->mutex);
+            conn->outbox += responses;
+            send_pending(*conn);
+            if (conn->inbox.empty() && !conn->session.stream)
             {
-                std::string id_str;
-                iss >> id_str;
-                if (!id_str.empty())
-                {
-                    try
-                    {
-                        int id_to_delete = std::stoi(id_str);
-                        std::vector<std::string> records = read_csv_data(g_csv_path);
-                        std::vector<std::string> new_records;
-                        bool found = false;
-                        if (!records.empty())
-                        {
-                            new_records.push_back(records[0]); // Keep header
-                        }
-                        for (size_t i = 1; i < records.size(); ++i)
-                        { // Start from 1 to skip header
-                            std::istringstream record_iss(records[i]);
-                            std::string current_id_field;
-                            std::getline(record_iss, current_id_field, ',');
-                            if (std::stoi(current_id_field) == id_to_delete)
-                            {
-                                found = true; // This record is the one to delete
-                            }
-                            else
-                            {
-                                new_records.push_back(records[i]); // Keep other records
-                            }
-                        }
-                        if (found)
-                        {
-                            if (write_csv_data(g_csv_path, new_records))
-                            {
-                                response = "Record ID " + id_str + " deleted.\n";
-                            }
-                            else
-                            {
-                                response = "ERROR: Failed to write to CSV file.\n";
-                            }
-                        }
-                        else
-                        {
-                            response = "ERROR: Record with ID " + id_str + " not found.\n";
-                        }
-                    }
-                    catch (const std::invalid_argument &e)
-                    {
-                        response = "ERROR: Invalid ID format.\n";
-                    }
-                    catch (const std::out_of_range &e)
-                    {
-                        response = "ERROR: ID out of range.\n";
-                    }
-                }
-                else
-                {
-                    response = "ERROR: DELETE command requires an ID.\n";
-                }
+                conn->busy = false;
+                return;
             }
         }
-        else
+        pool_.submit([this, conn] { run_next(conn); });
+    }
+
+    // Lock manager side: the lock wait of the connection's request ended
+    void resume(const std::shared_ptr<Connection> &conn)
+    {
+        std::lock_guard<std::mutex> lock(conn->mutex);
+        if (!conn->parked)
         {
-            response = "ERROR: Unknown command '" + command + "'.\nAvailable commands: QUERY <term>, BEGIN_TRANSACTION, COMMIT_TRANSACTION, ADD <data>, MODIFY <id> <data>, DELETE <id>, EXIT.\n";
+            conn->woken = true; // run_next has not parked it yet
+            return;
         }
-        send(client_sock_fd, response.c_str(), response.length(), 0);
+        conn->parked = false;
+        pool_.submit([this, conn] { run_next(conn); });
     }
 
-    // Client disconnected or read error
-    if (transaction_active)
+    // Reactor side: the socket has room again
+    void flush(const std::shared_ptr<Connection> &conn)
     {
-        flock(local_csv_fd, LOCK_UN); // Release lock if client disconnected during transaction
-        std::cerr << "[Handler PID " << getpid() << "] WARNING: Client disconnected during an active transaction. Lock released.\n";
+        std::lock_guard<std::mutex> lock(conn->mutex);
+        send_pending(*conn);
+        if (conn->stalled && conn->outbox.size() < OUTBOX_STREAM_BYTES / 2)
+        {
+            conn->stalled = false;
+            pool_.submit([this, conn] { run_next(conn); });
+        }
     }
-    close(local_csv_fd); // Close the file descriptor opened by this child
-    close(client_sock_fd);
-    std::cout << "[Handler PID " << getpid() << "] Client disconnected. Exiting child process." << std::endl;
-    _exit(0); // Child process exits
-}
 
-// Signal handler for SIGCHLD to reap zombie processes and decrement counter
-void sigchld_handler(int sig)
-{
-    int status;
-    pid_t pid;
-    // WNOHANG makes waitpid non-blocking, so it doesn't wait if no child has exited
-    // Loop to reap all exited children, not just one
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    // Sends as much of the outbox as the socket takes and adjusts the epoll
+    // interest: EPOLLOUT while output is pending, no EPOLLIN while too much is.
+    // Caller holds conn.mutex.
+    void send_pending(Connection &conn)
     {
-        active_child_processes--; // Decrement the global counter
-        std::cout << "[Parent PID " << getpid() << "] Child PID " << pid << " exited. Active children: " << active_child_processes << std::endl;
+        if (conn.closed)
+            return;
+        size_t sent = 0;
+        while (sent < conn.outbox.size())
+        {
+            ssize_t n = send(conn.session.fd, conn.outbox.data() + sent, conn.outbox.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+                break; // EAGAIN: wait for EPOLLOUT; errors surface as EPOLLERR/EPOLLHUP
+            sent += static_cast<size_t>(n);
+        }
+        conn.outbox.erase(0, sent);
+
+        uint32_t wanted = (conn.outbox.size() < OUTBOX_PAUSE_BYTES ? EPOLLIN : 0u) | (conn.outbox.empty() ? 0u : EPOLLOUT);
+        if (wanted != conn.events)
+        {
+            conn.events = wanted;
+            epoll_event ev{};
+            ev.events = wanted;
+            ev.data.fd = conn.session.fd;
+            epoll_ctl(epfd_, EPOLL_CTL_MOD, conn.session.fd, &ev);
+        }
     }
-}
+
+    std::vector<int> listen_fds_;
+    int epfd_ = -1;
+    WorkerPool pool_;
+    std::unordered_map<int, std::shared_ptr<Connection>> connections_; // Reactor thread only
+};
 
 int main(int argc, char *argv[])
 {
-    // AHORA se esperan 5 argumentos: <puerto> <ruta_csv> <N_concurrentes> <M_app_queue> <backlog_listen_kernel>
-    if (argc != 5)
+    // Se esperan 4 argumentos: <puerto> <ruta_csv> <N_concurrentes> <M_app_queue>, y opciones
+    if (argc < 5)
     {
-        std::cerr << "Uso: " << argv[0] << " <puerto> <ruta_csv> <N_clientes_concurrentes> <M_clientes_en_espera_app_queue>\n";
-        std::cerr << "   <N_clientes_concurrentes> (N) es el número máximo de clientes que el servidor manejará a la vez (procesos hijos).\n";
+        std::cerr << "Uso: " << argv[0] << " <puerto> <ruta_csv> <N_clientes_concurrentes> <M_clientes_en_espera_app_queue> [opciones]\n";
+        std::cerr << "   <N_clientes_concurrentes> (N) es el número máximo de clientes que el servidor manejará a la vez (hilos manejadores).\n";
         std::cerr << "   <M_clientes_en_espera_app_queue> (M) es el tamaño máximo de la cola de espera interna de la aplicación.\n";
         std::cerr << "   (El backlog del listen() se establecerá internamente para manejar conexiones entrantes).\n";
+        std::cerr << "   --modo hilos     un hilo por cliente (por defecto)\n";
+        std::cerr << "   --modo epoll     un reactor epoll y un pool de workers; los clientes inactivos no ocupan hilos\n";
+        std::cerr << "   --workers W      tamaño del pool en modo epoll (por defecto, un worker por CPU)\n";
+        std::cerr << "   --acceptors K    K sockets de escucha con SO_REUSEPORT (por defecto 1)\n";
+        std::cerr << "   --checkpoint-s S   compactar el log (<csv>.wal) en el CSV cada S segundos (por defecto 30)\n";
+        std::cerr << "   --checkpoint-mb X  o antes, si el log pasa X MiB (por defecto 64)\n";
+        std::cerr << "   --group-commit-us U  esperar U microsegundos a que se sumen más commits a un mismo fsync (por defecto 0:\n";
+        std::cerr << "                        solo se agrupan los que llegan mientras otro fsync está en curso)\n";
+        return 1;
+    }
+
+    bool epoll_mode = false;
+    int acceptors = 1;
+    int checkpoint_s = 30;
+    long checkpoint_mb = 64;
+    long group_commit_us = 0;
+    int workers = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    for (int i = 5; i < argc; ++i)
+    {
+        std::string opt = argv[i];
+        if (opt == "--modo" && i + 1 < argc)
+        {
+            std::string mode = argv[++i];
+            if (mode != "hilos" && mode != "epoll")
+            {
+                std::cerr << "ERROR: --modo debe ser 'hilos' o 'epoll'.\n";
+                return 1;
+            }
+            epoll_mode = mode == "epoll";
+        }
+        else if (opt == "--acceptors" && i + 1 < argc)
+        {
+            acceptors = std::atoi(argv[++i]);
+            if (acceptors <= 0)
+            {
+                std::cerr << "ERROR: --acceptors debe ser un entero positivo.\n";
+                return 1;
+            }
+        }
+        else if (opt == "--checkpoint-s" && i + 1 < argc)
+        {
+            checkpoint_s = std::atoi(argv[++i]);
+        }
+        else if (opt == "--checkpoint-mb" && i + 1 < argc)
+        {
+            checkpoint_mb = std::atol(argv[++i]);
+        }
+        else if (opt == "--group-commit-us" && i + 1 < argc)
+        {
+            group_commit_us = std::atol(argv[++i]);
+            if (group_commit_us < 0)
+            {
+                std::cerr << "ERROR: --group-commit-us no puede ser negativo.\n";
+                return 1;
+            }
+        }
+        else if (opt == "--workers" && i + 1 < argc)
+        {
+            workers = std::atoi(argv[++i]);
+            if (workers <= 0)
+            {
+                std::cerr << "ERROR: --workers debe ser un entero positivo.\n";
+                return 1;
+            }
+        }
+        else
+        {
+            std::cerr << "ERROR: opción desconocida o incompleta: " << opt << "\n";
+            return 1;
+        }
+    }
+    if (checkpoint_s <= 0 || checkpoint_mb <= 0)
+    {
+        std::cerr << "ERROR: --checkpoint-s y --checkpoint-mb deben ser positivos.\n";
         return 1;
     }
 
@@ -403,183 +4041,64 @@ int main(int argc, char *argv[])
 
     // --- LÍNEAS DE DEPURACIÓN AÑADIDAS ---
     std::cout << "[DEBUG] Server (PID " << getpid() << ") started." << std::endl;
-    std::cout << "[DEBUG] Initial active_child_processes: " << active_child_processes << std::endl;
+    std::cout << "[DEBUG] Initial active_client_handlers: " << active_client_handlers << std::endl;
     std::cout << "[DEBUG] Max allowed concurrent clients (N): " << max_allowed_concurrent_clients << std::endl;
     std::cout << "[DEBUG] Max waiting clients in app queue (M): " << max_app_waiting_clients_queue << std::endl;
     std::cout << "[DEBUG] Kernel listen() backlog set to: " << kernel_listen_backlog << std::endl;
     // ------------------------------------
 
-    // Set up SIGCHLD handler to prevent zombie processes and update counter
-    struct sigaction sa;
-    sa.sa_handler = sigchld_handler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART;
-    if (sigaction(SIGCHLD, &sa, NULL) == -1)
-    {
-        perror("sigaction for SIGCHLD");
-        return 1;
-    }
-
-    // --- Server Socket Setup ---
-    int server_fd, new_socket;
-    struct sockaddr_in address;
-    int opt = 1;
-    socklen_t addrlen = sizeof(address);
-
-    // Create socket file descriptor
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0)
-    {
-        perror("socket failed");
-        return 1;
-    }
+    // Handlers are threads now: a client that disconnects mid-send must not kill
+    // the whole server with SIGPIPE (send just fails with EPIPE).
+    signal(SIGPIPE, SIG_IGN);
 
-    // Forcefully attach socket to the port (prevents "Address already in use" after crash)
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt)))
-    {
-        perror("setsockopt");
-        close(server_fd);
+    // Load the table once; handlers serve every command from memory
+    if (!load_table(g_csv_path))
         return 1;
-    }
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY; // Listen on all available network interfaces
-    address.sin_port = htons(port);
-
-    // Bind the socket to the specified port
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0)
-    {
-        perror("bind failed");
-        close(server_fd);
+    std::cout << "Loaded " << g_table.rows.load()->size() << " records from " << g_csv_path << std::endl;
+    if (!recover_from_wal(g_csv_path) || !g_wal.open_log(g_csv_path))
         return 1;
-    }
+    g_wal.set_group_window(std::chrono::microseconds(group_commit_us));
+    std::thread(checkpoint_loop, checkpoint_s, static_cast<off_t>(checkpoint_mb) << 20).detach();
+    std::thread(compaction_loop).detach();
+    std::thread(&LockManager::expire_loop, &g_locks).detach();
 
-    // Usar kernel_listen_backlog para el backlog de listen()
-    if (listen(server_fd, kernel_listen_backlog) < 0)
+    // --- Server Socket Setup ---
+    // Uno o más sockets de escucha en el mismo puerto (SO_REUSEPORT)
+    std::vector<int> listen_fds;
+    for (int a = 0; a < acceptors; ++a)
     {
-        perror("listen");
-        close(server_fd);
-        return 1;
+        int fd = open_listen_socket(port, kernel_listen_backlog);
+        if (fd == -1)
+        {
+            for (int opened : listen_fds)
+                close(opened);
+            return 1;
+        }
+        listen_fds.push_back(fd);
     }
 
     std::cout << "Server listening on port " << port << " for CSV file: " << g_csv_path << std::endl;
     std::cout << "Maximum concurrent clients allowed (N): " << max_allowed_concurrent_clients << std::endl;
     std::cout << "Maximum clients in application waiting queue (M): " << max_app_waiting_clients_queue << std::endl;
+    std::cout << "Acceptors: " << acceptors << std::endl;
     std::cout << "Waiting for client connections...\n";
 
-    // Establecer el socket de escucha en modo no bloqueante
-    // Esto es crucial para poder intentar accept() y luego revisar la cola sin bloquearse.
-    int flags = fcntl(server_fd, F_GETFL, 0);
-    if (flags == -1)
-    {
-        perror("fcntl F_GETFL");
-        close(server_fd);
-        return 1;
-    }
-    if (fcntl(server_fd, F_SETFL, flags | O_NONBLOCK) == -1)
+    if (epoll_mode)
     {
-        perror("fcntl F_SETFL O_NONBLOCK");
-        close(server_fd);
-        return 1;
+        std::cout << "Mode: epoll reactor with " << workers << " workers\n";
+        EpollServer server(listen_fds, workers);
+        int rc = server.run();
+        for (int fd : listen_fds)
+            close(fd);
+        return rc;
     }
 
-    while (true)
-    {
-        // --- Paso 1: Intentar aceptar nuevas conexiones entrantes (no bloqueante) ---
-        // Se hace de forma no bloqueante para poder procesar la cola de espera y los hijos salientes.
-        if ((new_socket = accept(server_fd, (struct sockaddr *)&address, &addrlen)) >= 0)
-        {
-            std::cout << "[Parent PID " << getpid() << "] New client accepted from " << inet_ntoa(address.sin_addr) << ":" << ntohs(address.sin_port) << std::endl;
-
-            if (active_child_processes < max_allowed_concurrent_clients)
-            {
-                // N clientes concurrentes NO alcanzado: asignar un manejador hijo inmediatamente
-                // Enviar un mensaje de "listo" antes de forkar, para que el cliente sepa que será atendido.
-                std::string ready_msg = "SERVER: Connected and ready to process commands.\n";
-                send(new_socket, ready_msg.c_str(), ready_msg.length(), 0);
-
-                pid_t pid = fork();
-                if (pid < 0)
-                {
-                    perror("fork failed");
-                    std::string err_msg = "ERROR: Server could not fork a new process to handle client.\n";
-                    send(new_socket, err_msg.c_str(), err_msg.length(), 0);
-                    close(new_socket); // Cerrar el socket para el padre en caso de fallo de fork
-                }
-                else if (pid == 0)
-                {                     // Proceso hijo
-                    close(server_fd); // El hijo cierra el socket de escucha
-                    handle_client(new_socket, getpid());
-                    // _exit(0) se llama dentro de handle_client
-                }
-                else
-                {                             // Proceso padre
-                    close(new_socket);        // El padre cierra el socket del nuevo cliente (el hijo lo maneja)
-                    active_child_processes++; // Incrementar contador de hijos activos
-                    std::cout << "[Parent PID " << getpid() << "] Forked child PID " << pid << ". Active children: " << active_child_processes << std::endl;
-                }
-            }
-            else if (waiting_client_sockets.size() < max_app_waiting_clients_queue)
-            {
-                // N clientes concurrentes YA alcanzado, pero la cola de la aplicación NO está llena.
-                // Enviar mensaje de espera y encolar el socket.
-                std::string wait_msg = "SERVER: Max concurrent clients reached. You are in waiting queue. Please wait...\n";
-                send(new_socket, wait_msg.c_str(), wait_msg.length(), 0);
-                waiting_client_sockets.push(new_socket);
-                std::cout << "[Parent PID " << getpid() << "] Client " << inet_ntoa(address.sin_addr) << ":" << ntohs(address.sin_port) << " enqueued. Waiting queue size: " << waiting_client_sockets.size() << std::endl;
-            }
-            else
-            {
-                // N clientes concurrentes YA alcanzado Y la cola de la aplicación TAMBIÉN está llena.
-                // Rechazar la conexión explícitamente.
-                std::string refused_msg = "SERVER: Connection refused. Server's active client limit reached and waiting queue is full. Please try again later.\n";
-                send(new_socket, refused_msg.c_str(), refused_msg.length(), 0);
-                std::cout << "[Parent PID " << getpid() << "] Client " << inet_ntoa(address.sin_addr) << ":" << ntohs(address.sin_port) << " refused (queue full).\n";
-                close(new_socket); // Es crucial cerrar el socket aquí.
-            }
-        }
-        else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
-        {
-            // Un error real en accept que no sea "no hay conexiones pendientes" o "interrumpido por señal"
-            perror("accept");
-            // Considerar cerrar el servidor en caso de errores críticos de accept
-        }
-
-        // --- Paso 2: Procesar la cola de clientes en espera si hay slots disponibles (N no alcanzado) ---
-        // Revisamos si un hijo terminó y liberó un slot, y si hay clientes en la cola de espera.
-        while (!waiting_client_sockets.empty() && active_child_processes < max_allowed_concurrent_clients)
-        {
-            int client_sock_from_queue = waiting_client_sockets.front();
-            waiting_client_sockets.pop();
-
-            std::cout << "[Parent PID " << getpid() << "] Dequeuing client from waiting list. Queue size: " << waiting_client_sockets.size() << std::endl;
-
-            // Enviar un mensaje de "es tu turno" antes de forkar el manejador
-            std::string turn_msg = "SERVER: Your turn! Processing your request now.\n";
-            send(client_sock_from_queue, turn_msg.c_str(), turn_msg.length(), 0);
-
-            pid_t pid = fork();
-            if (pid < 0)
-            {
-                perror("fork failed for queued client");
-                std::string err_msg = "ERROR: Server could not fork a new process for queued client.\n";
-                send(client_sock_from_queue, err_msg.c_str(), err_msg.length(), 0);
-                close(client_sock_from_queue); // Cerrar el socket si no se puede forkar
-            }
-            else if (pid == 0)
-            {                     // Proceso hijo
-                close(server_fd); // El hijo cierra el socket de escucha
-                handle_client(client_sock_from_queue, getpid());
-            }
-            else
-            {                                  // Proceso padre
-                close(client_sock_from_queue); // El padre cierra el socket (el hijo lo maneja)
-                active_child_processes++;      // Incrementar contador de hijos activos
-                std::cout << "[Parent PID " << getpid() << "] Forked child PID " << pid << " for queued client. Active children: " << active_child_processes << std::endl;
-            }
-        }
-
-        usleep(50000); // Pequeña pausa para no consumir CPU inútilmente si no hay actividad
-    }
+    // Un hilo acceptor por socket extra; el primero corre en el hilo principal
+    for (size_t a = 1; a < listen_fds.size(); ++a)
+        std::thread(acceptor_loop, listen_fds[a]).detach();
+    acceptor_loop(listen_fds[0]);
 
-    close(server_fd);
+    for (int fd : listen_fds)
+        close(fd);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,128 @@
+// test_snapshot_ids.cpp
+// Prueba: un MODIFY que cambia el ID de un registro no es visible para otras
+// sesiones hasta el COMMIT, y una lectura anterior al COMMIT sigue viendo el ID viejo.
+// Compilar: g++ -std=gnu++17 test_snapshot_ids.cpp -o test_snapshot_ids
+// Ejecutar: ./test_snapshot_ids ./server   (levanta el servidor en el puerto 9411)
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+const int PORT = 9411;
+const char *CSV = "/tmp/test_snapshot_ids.csv";
+
+// Conecta al servidor, reintentando mientras arranca, y descarta el saludo
+int connect_client() {
+    for (int attempt = 0; attempt < 50; attempt++) {
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(PORT);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+            std::string greeting;
+            char c;
+            while (greeting.find("ready") == std::string::npos && read(sock, &c, 1) == 1) {
+                greeting += c;
+            }
+            while (greeting.back() != '\n' && read(sock, &c, 1) == 1) {
+                greeting += c;
+            }
+            return sock;
+        }
+        close(sock);
+        usleep(100000);
+    }
+    return -1;
+}
+
+// Envía un comando y lee su respuesta completa: bloques "<largo>\n<datos>" hasta "0\n"
+std::string command(int sock, const std::string& cmd) {
+    std::string line = cmd + "\n", response;
+    if (write(sock, line.data(), line.size()) != static_cast<ssize_t>(line.size())) {
+        return "";
+    }
+    while (true) {
+        std::string len;
+        char c;
+        while (read(sock, &c, 1) == 1 && c != '\n') {
+            len += c;
+        }
+        size_t n = std::stoul(len.empty() ? "0" : len);
+        if (n == 0) {
+            return response;
+        }
+        std::string chunk(n, '\0');
+        for (size_t got = 0; got < n;) {
+            ssize_t r = read(sock, &chunk[got], n - got);
+            if (r <= 0) {
+                return response;
+            }
+            got += r;
+        }
+        response += chunk;
+    }
+}
+
+int failures = 0;
+
+void expect(const std::string& what, const std::string& response, const std::string& needle) {
+    bool ok = response.find(needle) != std::string::npos;
+    std::cout << (ok ? "OK   " : "FAIL ") << what << "\n";
+    if (!ok) {
+        std::cout << "     esperaba '" << needle << "', llegó: " << response;
+        failures++;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "Uso: " << argv[0] << " <ruta_al_server>\n";
+        return 1;
+    }
+    std::ofstream(CSV) << "ID,Nombre,Edad,Ciudad,Fuente\n1,Ana,25,Cordoba,Gen1\n2,Luis,30,Salta,Gen1\n";
+    std::remove((std::string(CSV) + ".wal").c_str());
+
+    pid_t server = fork();
+    if (server == 0) {
+        execl(argv[1], argv[1], std::to_string(PORT).c_str(), CSV, "5", "5", static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    int a = connect_client(), b = connect_client();
+    if (a < 0 || b < 0) {
+        std::cerr << "No se pudo conectar al servidor.\n";
+        kill(server, SIGTERM);
+        return 1;
+    }
+
+    command(b, "OPEN_CURSOR ID=1"); // Snapshot anterior a todo el cambio
+    command(a, "BEGIN_TRANSACTION");
+    expect("A cambia el ID 1 por 100", command(a, "MODIFY 1 100,Ana,26,Cordoba,Gen1"), "modified");
+    expect("A ve su propio cambio", command(a, "GET 100"), "100,Ana,26");
+    expect("B sigue viendo el ID 1 (GET)", command(b, "GET 1"), "1,Ana,25");
+    expect("B sigue viendo el ID 1 (QUERY)", command(b, "QUERY ID=1"), "1,Ana,25");
+    expect("B no ve el ID 100", command(b, "GET 100"), "not found");
+    expect("A confirma", command(a, "COMMIT_TRANSACTION"), "committed");
+    expect("B ve el ID 100 tras el COMMIT", command(b, "GET 100"), "100,Ana,26");
+    expect("B ya no ve el ID 1", command(b, "GET 1"), "not found");
+    usleep(500000); // Deja correr la limpieza de fondo, que no debe olvidar el ID viejo
+    expect("El cursor abierto antes ve el ID 1", command(b, "FETCH 1 5"), "1,Ana,25");
+    command(b, "CLOSE_CURSOR 1");
+    usleep(500000); // Sin lecturas viejas la entrada del ID 1 se descarta
+    expect("B sigue sin ver el ID 1", command(b, "GET 1"), "not found");
+    expect("El ID 100 sigue en su lugar", command(a, "GET 100"), "100,Ana,26");
+
+    close(a);
+    close(b);
+    kill(server, SIGTERM);
+    waitpid(server, nullptr, 0);
+    std::cout << (failures == 0 ? "Todas las pruebas pasaron.\n" : "Hubo fallas.\n");
+    return failures == 0 ? 0 : 1;
+}